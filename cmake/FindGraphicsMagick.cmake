@@ -51,7 +51,7 @@ find_program(GraphicsMagick_EXECUTABLE NAMES gm
 
 set(GraphicsMagick_devel "-1")
 if(GraphicsMagick_FIND_COMPONENTS)
-	list(FIND ${GraphicsMagick_FIND_COMPONENTS} devel GraphicsMagick_devel )
+	list(FIND GraphicsMagick_FIND_COMPONENTS devel GraphicsMagick_devel )
 endif()
 if(${GraphicsMagick_devel} MATCHES "-1")
 
@@ -72,6 +72,8 @@ else()
 			"[HKEY_LOCAL_MACHINE\\SOFTWARE\\WoW6432Node\\GraphicsMagick\\Current;ConfigurePath]/include"
 			/usr/include/magick
 			/usr/include/
+			/usr/include/GraphicsMagick/magick
+			/usr/include/GraphicsMagick/
 			/usr/local/include
 			/usr/local/include/GraphicsMagick/magick
 			/usr/local/include/GraphicsMagick/
@@ -0,0 +1,60 @@
+## FindLibRaw.cmake
+## Find the native LibRaw includes and library
+##
+## This module defines :
+## 	[in] 	LIBRAW_DIR, The base directory to search for LibRaw (as cmake var or env var)
+## 	[out] 	LIBRAW_INCLUDE_DIR where to find libraw/libraw.h
+## 	[out] 	LIBRAW_LIBRARIES, libraries to link against to use LibRaw
+## 	[out] 	LIBRAW_FOUND, If false, do not try to use LibRaw.
+
+if(NOT LIBRAW_DIR)
+	if(NOT $ENV{LIBRAW_DIR} STREQUAL "")
+		set(LIBRAW_DIR $ENV{LIBRAW_DIR} CACHE PATH "The root installation path to LibRaw" FORCE)
+	else()
+		set(LIBRAW_DIR "" CACHE PATH "The root installation path to LibRaw")
+	endif()
+endif()
+
+set(PROGRAMFILESx86 "PROGRAMFILES(x86)")
+
+set(_libraw_SEARCH_DIRS
+	${LIBRAW_DIR}
+	/usr/local
+	/sw 		# Fink
+	/opt/local 	# DarwinPorts
+	/opt/csw 	# Blastwave
+	$ENV{PROGRAMFILES}/LibRaw
+	$ENV{${PROGRAMFILESx86}}/LibRaw
+	$ENV{ProgramW6432}/LibRaw
+)
+
+FIND_PATH(LIBRAW_INCLUDE_DIR
+	NAMES 			libraw/libraw.h
+	PATHS			${_libraw_SEARCH_DIRS}
+	PATH_SUFFIXES 	include
+)
+
+FIND_LIBRARY(LIBRAW_LIBRARY
+	NAMES			raw libraw
+	PATHS			${_libraw_SEARCH_DIRS}
+	PATH_SUFFIXES	lib64 lib
+)
+
+INCLUDE(FindPackageHandleStandardArgs)
+FIND_PACKAGE_HANDLE_STANDARD_ARGS(LibRaw DEFAULT_MSG
+	LIBRAW_LIBRARY
+	LIBRAW_INCLUDE_DIR
+)
+
+if(LIBRAW_FOUND)
+	set(LibRaw_FOUND ON)
+	set(LIBRAW_INCLUDE_DIRS 	${LIBRAW_INCLUDE_DIR})
+	set(LIBRAW_LIBRARIES 		${LIBRAW_LIBRARY})
+else()
+	set(LibRaw_FOUND OFF)
+endif()
+
+mark_as_advanced(
+	LIBRAW_INCLUDE_DIR
+	LIBRAW_LIBRARY
+)
@@ -0,0 +1,347 @@
+#include "ChannelKernels.h"
+
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CHANNEL_KERNELS_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+namespace
+{
+	// least common multiple of the channels count and the number of elements loaded per iteration,
+	// so that each accumulator lane always sees the same channel (elements is a power of 2 >= 4)
+	constexpr int groupSize(int nbChannels, int elements) {return nbChannels == 3 ? 3*elements : elements;}
+
+	template<typename T, typename S>
+	void sumScalar(const T *pixels, std::size_t nbPixels, int nbChannels, S *sums)
+	{
+		for(std::size_t i = 0; i < nbPixels; i++)
+			for(int c = 0; c < nbChannels; c++)
+				sums[c] += S(pixels[i*nbChannels + c]);
+	}
+
+	// elements left after the SIMD groups always begin with the channel 0 (groups are a multiple of the channels count)
+	template<typename T, typename S>
+	void sumTail(const T *elements, std::size_t nbElements, int nbChannels, S *sums)
+	{
+		for(std::size_t e = 0; e < nbElements; e++)
+			sums[e % nbChannels] += S(elements[e]);
+	}
+
+	// half to float : the exponent/mantissa bits are shifted in place and rescaled by 2^112 (which also handle denormals),
+	// infinity/NaN get the float max exponent back. Same steps as the SIMD versions.
+	float halfToFloat(std::uint16_t half)
+	{
+		union {std::uint32_t u; float f;} bits;
+		std::uint32_t expMant = half & 0x7fffu;
+		bits.u	= expMant << 13;
+		bits.f	*= 5.192296858534828e33f; // 2^112
+		if(expMant > 0x7bffu)
+			bits.u |= 255u << 23;
+		bits.u	|= std::uint32_t(half & 0x8000u) << 16;
+		return bits.f;
+	}
+
+	void sumHalfScalar(const std::uint16_t *pixels, std::size_t nbPixels, int nbChannels, double *sums)
+	{
+		for(std::size_t i = 0; i < nbPixels; i++)
+			for(int c = 0; c < nbChannels; c++)
+				sums[c] += halfToFloat(pixels[i*nbChannels + c]);
+	}
+
+	bool cpuHasAVX2()
+	{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+		int info[4];
+		__cpuid(info, 0);
+		if(info[0] < 7)
+			return false;
+		__cpuid(info, 1);
+		bool osxsave	= (info[2] & (1<<27)) != 0;
+		bool avx		= (info[2] & (1<<28)) != 0;
+		if(!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6) // the OS has to save the YMM registers
+			return false;
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1<<5)) != 0;
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2") != 0;
+#else
+		return false;
+#endif
+	}
+
+#ifdef CHANNEL_KERNELS_SSE2
+
+	template<int NC>
+	void flushLanes(const __m128i *acc, int nbAcc, std::uint64_t *sums)
+	{
+		for(int a = 0; a < nbAcc; a++)
+		{
+			std::uint32_t lanes[4];
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), acc[a]);
+			for(int j = 0; j < 4; j++)
+				sums[(a*4 + j) % NC] += lanes[j];
+		}
+	}
+
+	template<int NC>
+	void flushLanes(const __m128 *acc, int nbAcc, double *sums)
+	{
+		for(int a = 0; a < nbAcc; a++)
+		{
+			float lanes[4];
+			_mm_storeu_ps(lanes, acc[a]);
+			for(int j = 0; j < 4; j++)
+				sums[(a*4 + j) % NC] += lanes[j];
+		}
+	}
+
+	template<int NC>
+	void sumUInt8SSE2(const std::uint8_t *pixels, std::size_t nbPixels, std::uint64_t *sums)
+	{
+		constexpr int		G			= groupSize(NC, 16);	// elements per group (16 per load)
+		constexpr int		A			= G / 4;				// 4 x 32 bits accumulators
+		const std::size_t	nbElements	= nbPixels * NC;
+		const std::size_t	nbGroups	= nbElements / G;
+		const __m128i		zero		= _mm_setzero_si128();
+
+		std::size_t g = 0;
+		while(g < nbGroups)
+		{
+			// 32 bits lanes cannot overflow while adding up to 2^24 values of 8 bits
+			std::size_t blockEnd = std::min(nbGroups, g + (std::size_t(1) << 20));
+			__m128i acc[A];
+			for(int a = 0; a < A; a++)
+				acc[a] = zero;
+			for(; g < blockEnd; g++)
+			{
+				const __m128i *src = reinterpret_cast<const __m128i*>(pixels + g*G);
+				for(int l = 0; l < G/16; l++)
+				{
+					__m128i v	= _mm_loadu_si128(src + l);
+					__m128i lo	= _mm_unpacklo_epi8(v, zero);
+					__m128i hi	= _mm_unpackhi_epi8(v, zero);
+					acc[4*l]	= _mm_add_epi32(acc[4*l],	_mm_unpacklo_epi16(lo, zero));
+					acc[4*l+1]	= _mm_add_epi32(acc[4*l+1],	_mm_unpackhi_epi16(lo, zero));
+					acc[4*l+2]	= _mm_add_epi32(acc[4*l+2],	_mm_unpacklo_epi16(hi, zero));
+					acc[4*l+3]	= _mm_add_epi32(acc[4*l+3],	_mm_unpackhi_epi16(hi, zero));
+				}
+			}
+			flushLanes<NC>(acc, A, sums);
+		}
+		sumTail(pixels + nbGroups*G, nbElements - nbGroups*G, NC, sums);
+	}
+
+	template<int NC>
+	void sumUInt16SSE2(const std::uint16_t *pixels, std::size_t nbPixels, std::uint64_t *sums)
+	{
+		constexpr int		G			= groupSize(NC, 8);		// elements per group (8 per load)
+		constexpr int		A			= G / 4;				// 4 x 32 bits accumulators
+		const std::size_t	nbElements	= nbPixels * NC;
+		const std::size_t	nbGroups	= nbElements / G;
+		const __m128i		zero		= _mm_setzero_si128();
+
+		std::size_t g = 0;
+		while(g < nbGroups)
+		{
+			// 32 bits lanes cannot overflow while adding up to 2^16 values of 16 bits
+			std::size_t blockEnd = std::min(nbGroups, g + (std::size_t(1) << 16));
+			__m128i acc[A];
+			for(int a = 0; a < A; a++)
+				acc[a] = zero;
+			for(; g < blockEnd; g++)
+			{
+				const __m128i *src = reinterpret_cast<const __m128i*>(pixels + g*G);
+				for(int l = 0; l < G/8; l++)
+				{
+					__m128i v	= _mm_loadu_si128(src + l);
+					acc[2*l]	= _mm_add_epi32(acc[2*l],	_mm_unpacklo_epi16(v, zero));
+					acc[2*l+1]	= _mm_add_epi32(acc[2*l+1],	_mm_unpackhi_epi16(v, zero));
+				}
+			}
+			flushLanes<NC>(acc, A, sums);
+		}
+		sumTail(pixels + nbGroups*G, nbElements - nbGroups*G, NC, sums);
+	}
+
+	// 4 halves (in the low 16 bits of each 32 bits lane) to 4 floats
+	inline __m128 halfToFloatSSE2(__m128i halves)
+	{
+		const __m128i	noSign		= _mm_set1_epi32(0x7fff);
+		const __m128	magic		= _mm_castsi128_ps(_mm_set1_epi32((254 - 15) << 23));	// 2^112
+		const __m128i	wasInfNaN	= _mm_set1_epi32(0x7bff);
+		const __m128	expInfNaN	= _mm_castsi128_ps(_mm_set1_epi32(255 << 23));
+
+		__m128i expMant	= _mm_and_si128(noSign, halves);
+		__m128i sign	= _mm_slli_epi32(_mm_xor_si128(halves, expMant), 16);
+		__m128	scaled	= _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(expMant, 13)), magic);
+		__m128	infNaN	= _mm_and_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(expMant, wasInfNaN)), expInfNaN);
+		return _mm_or_ps(scaled, _mm_or_ps(_mm_castsi128_ps(sign), infNaN));
+	}
+
+	template<int NC>
+	void sumHalfSSE2(const std::uint16_t *pixels, std::size_t nbPixels, double *sums)
+	{
+		constexpr int		G			= groupSize(NC, 8);		// elements per group (8 per load)
+		constexpr int		A			= G / 4;				// 4 x float accumulators
+		const std::size_t	nbElements	= nbPixels * NC;
+		const std::size_t	nbGroups	= nbElements / G;
+		const __m128i		zero		= _mm_setzero_si128();
+
+		std::size_t g = 0;
+		while(g < nbGroups)
+		{
+			// flush the float lanes into double sums often enough to keep the float precision loss negligible
+			std::size_t blockEnd = std::min(nbGroups, g + 1024);
+			__m128 acc[A];
+			for(int a = 0; a < A; a++)
+				acc[a] = _mm_setzero_ps();
+			for(; g < blockEnd; g++)
+			{
+				const __m128i *src = reinterpret_cast<const __m128i*>(pixels + g*G);
+				for(int l = 0; l < G/8; l++)
+				{
+					__m128i v	= _mm_loadu_si128(src + l);
+					acc[2*l]	= _mm_add_ps(acc[2*l],		halfToFloatSSE2(_mm_unpacklo_epi16(v, zero)));
+					acc[2*l+1]	= _mm_add_ps(acc[2*l+1],	halfToFloatSSE2(_mm_unpackhi_epi16(v, zero)));
+				}
+			}
+			flushLanes<NC>(acc, A, sums);
+		}
+		const std::uint16_t *tail = pixels + nbGroups*G;
+		for(std::size_t e = 0; e < nbElements - nbGroups*G; e++)
+			sums[e % NC] += halfToFloat(tail[e]);
+	}
+
+	template<int NC>
+	void sumFloatSSE2(const float *pixels, std::size_t nbPixels, double *sums)
+	{
+		constexpr int		G			= groupSize(NC, 4);		// elements per group (4 per load)
+		constexpr int		A			= G / 4;				// 4 x float accumulators
+		const std::size_t	nbElements	= nbPixels * NC;
+		const std::size_t	nbGroups	= nbElements / G;
+
+		std::size_t g = 0;
+		while(g < nbGroups)
+		{
+			// flush the float lanes into double sums often enough to keep the float precision loss negligible
+			std::size_t blockEnd = std::min(nbGroups, g + 1024);
+			__m128 acc[A];
+			for(int a = 0; a < A; a++)
+				acc[a] = _mm_setzero_ps();
+			for(; g < blockEnd; g++)
+				for(int l = 0; l < A; l++)
+					acc[l] = _mm_add_ps(acc[l], _mm_loadu_ps(pixels + g*G + l*4));
+			flushLanes<NC>(acc, A, sums);
+		}
+		sumTail(pixels + nbGroups*G, nbElements - nbGroups*G, NC, sums);
+	}
+
+#endif
+}
+
+//---------------------------------------------------------------------
+
+int ChannelKernels::level()
+{
+	static const int kernelsLevel = (avx2Built() && cpuHasAVX2()) ? 2
+#ifdef CHANNEL_KERNELS_SSE2
+		: 1;
+#else
+		: 0;
+#endif
+	return kernelsLevel;
+}
+
+const char* ChannelKernels::instructionSet()
+{
+	switch(level())
+	{
+	case 2:		return "AVX2";
+	case 1:		return "SSE2";
+	default:	return "scalar";
+	}
+}
+
+//---------------------------------------------------------------------
+
+void ChannelKernels::sumUInt8(const std::uint8_t *pixels, std::size_t nbPixels, int nbChannels, std::uint64_t *sums)
+{
+	if(nbChannels < 1 || nbChannels > 4 || level() == 0)
+		return sumScalar(pixels, nbPixels, nbChannels, sums);
+	if(level() == 2)
+		return sumUInt8AVX2(pixels, nbPixels, nbChannels, sums);
+#ifdef CHANNEL_KERNELS_SSE2
+	switch(nbChannels)
+	{
+	case 1:	return sumUInt8SSE2<1>(pixels, nbPixels, sums);
+	case 2:	return sumUInt8SSE2<2>(pixels, nbPixels, sums);
+	case 3:	return sumUInt8SSE2<3>(pixels, nbPixels, sums);
+	case 4:	return sumUInt8SSE2<4>(pixels, nbPixels, sums);
+	}
+#endif
+}
+
+//---------------------------------------------------------------------
+
+void ChannelKernels::sumUInt16(const std::uint16_t *pixels, std::size_t nbPixels, int nbChannels, std::uint64_t *sums)
+{
+	if(nbChannels < 1 || nbChannels > 4 || level() == 0)
+		return sumScalar(pixels, nbPixels, nbChannels, sums);
+	if(level() == 2)
+		return sumUInt16AVX2(pixels, nbPixels, nbChannels, sums);
+#ifdef CHANNEL_KERNELS_SSE2
+	switch(nbChannels)
+	{
+	case 1:	return sumUInt16SSE2<1>(pixels, nbPixels, sums);
+	case 2:	return sumUInt16SSE2<2>(pixels, nbPixels, sums);
+	case 3:	return sumUInt16SSE2<3>(pixels, nbPixels, sums);
+	case 4:	return sumUInt16SSE2<4>(pixels, nbPixels, sums);
+	}
+#endif
+}
+
+//---------------------------------------------------------------------
+
+void ChannelKernels::sumHalf(const std::uint16_t *pixels, std::size_t nbPixels, int nbChannels, double *sums)
+{
+	if(nbChannels < 1 || nbChannels > 4 || level() == 0)
+		return sumHalfScalar(pixels, nbPixels, nbChannels, sums);
+	if(level() == 2)
+		return sumHalfAVX2(pixels, nbPixels, nbChannels, sums);
+#ifdef CHANNEL_KERNELS_SSE2
+	switch(nbChannels)
+	{
+	case 1:	return sumHalfSSE2<1>(pixels, nbPixels, sums);
+	case 2:	return sumHalfSSE2<2>(pixels, nbPixels, sums);
+	case 3:	return sumHalfSSE2<3>(pixels, nbPixels, sums);
+	case 4:	return sumHalfSSE2<4>(pixels, nbPixels, sums);
+	}
+#endif
+}
+
+//---------------------------------------------------------------------
+
+void ChannelKernels::sumFloat(const float *pixels, std::size_t nbPixels, int nbChannels, double *sums)
+{
+	if(nbChannels < 1 || nbChannels > 4 || level() == 0)
+		return sumScalar(pixels, nbPixels, nbChannels, sums);
+	if(level() == 2)
+		return sumFloatAVX2(pixels, nbPixels, nbChannels, sums);
+#ifdef CHANNEL_KERNELS_SSE2
+	switch(nbChannels)
+	{
+	case 1:	return sumFloatSSE2<1>(pixels, nbPixels, sums);
+	case 2:	return sumFloatSSE2<2>(pixels, nbPixels, sums);
+	case 3:	return sumFloatSSE2<3>(pixels, nbPixels, sums);
+	case 4:	return sumFloatSSE2<4>(pixels, nbPixels, sums);
+	}
+#endif
+}
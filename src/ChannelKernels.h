@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/// Channels reduction kernels used by the ImagePlugin averages computation.
+/// Each kernel add to sums[nbChannels] the per channel sums of nbPixels contiguous pixels (nbChannels interleaved values each).
+/// Integer formats are accumulated exactly, half floats (IEEE 754 binary16 bits) are expanded to float in registers.
+/// SSE2/AVX2 versions are selected at runtime (with a scalar fallback),
+/// for 1 to 4 channels per pixel (other channels count always use the scalar version).
+class ChannelKernels
+{
+public:
+	static void sumUInt8	(const std::uint8_t		*pixels, std::size_t nbPixels, int nbChannels, std::uint64_t *sums);
+	static void sumUInt16	(const std::uint16_t	*pixels, std::size_t nbPixels, int nbChannels, std::uint64_t *sums);
+	static void sumHalf		(const std::uint16_t	*pixels, std::size_t nbPixels, int nbChannels, double		 *sums);
+	static void sumFloat	(const float			*pixels, std::size_t nbPixels, int nbChannels, double		 *sums);
+
+	/// Name of the instruction set selected at runtime ("AVX2", "SSE2" or "scalar")
+	static const char* instructionSet();
+
+private:
+	/// Kernels level detected once at first use : 0 scalar, 1 SSE2, 2 AVX2
+	static int level();
+
+	// implemented in ChannelKernelsAVX2.cpp (the only file built with AVX2 enabled), only called after the runtime cpu check
+	static bool avx2Built();
+	static void sumUInt8AVX2	(const std::uint8_t		*pixels, std::size_t nbPixels, int nbChannels, std::uint64_t *sums);
+	static void sumUInt16AVX2	(const std::uint16_t	*pixels, std::size_t nbPixels, int nbChannels, std::uint64_t *sums);
+	static void sumHalfAVX2		(const std::uint16_t	*pixels, std::size_t nbPixels, int nbChannels, double		 *sums);
+	static void sumFloatAVX2	(const float			*pixels, std::size_t nbPixels, int nbChannels, double		 *sums);
+};
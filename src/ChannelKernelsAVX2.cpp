@@ -0,0 +1,246 @@
+#include "ChannelKernels.h"
+
+// This file is the only one built with AVX2 code generation enabled (see CMakeLists.txt).
+// Its kernels are only called by ChannelKernels after the runtime cpu check.
+
+#ifdef __AVX2__
+
+#include <immintrin.h>
+#include <algorithm>
+
+namespace
+{
+	// least common multiple of the channels count and the number of elements loaded per iteration
+	constexpr int groupSize(int nbChannels, int elements) {return nbChannels == 3 ? 3*elements : elements;}
+
+	template<typename T, typename S>
+	void sumTail(const T *elements, std::size_t nbElements, int nbChannels, S *sums)
+	{
+		for(std::size_t e = 0; e < nbElements; e++)
+			sums[e % nbChannels] += S(elements[e]);
+	}
+
+	template<int NC>
+	void flushLanes(const __m256i *acc, int nbAcc, std::uint64_t *sums)
+	{
+		for(int a = 0; a < nbAcc; a++)
+		{
+			std::uint32_t lanes[8];
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), acc[a]);
+			for(int j = 0; j < 8; j++)
+				sums[(a*8 + j) % NC] += lanes[j];
+		}
+	}
+
+	template<int NC>
+	void flushLanes(const __m256 *acc, int nbAcc, double *sums)
+	{
+		for(int a = 0; a < nbAcc; a++)
+		{
+			float lanes[8];
+			_mm256_storeu_ps(lanes, acc[a]);
+			for(int j = 0; j < 8; j++)
+				sums[(a*8 + j) % NC] += lanes[j];
+		}
+	}
+
+	template<int NC>
+	void sumUInt8Kernel(const std::uint8_t *pixels, std::size_t nbPixels, std::uint64_t *sums)
+	{
+		constexpr int		G			= groupSize(NC, 16);	// elements per group (16 per load)
+		constexpr int		A			= G / 8;				// 8 x 32 bits accumulators
+		const std::size_t	nbElements	= nbPixels * NC;
+		const std::size_t	nbGroups	= nbElements / G;
+
+		std::size_t g = 0;
+		while(g < nbGroups)
+		{
+			// 32 bits lanes cannot overflow while adding up to 2^24 values of 8 bits
+			std::size_t blockEnd = std::min(nbGroups, g + (std::size_t(1) << 20));
+			__m256i acc[A];
+			for(int a = 0; a < A; a++)
+				acc[a] = _mm256_setzero_si256();
+			for(; g < blockEnd; g++)
+			{
+				const __m128i *src = reinterpret_cast<const __m128i*>(pixels + g*G);
+				for(int l = 0; l < G/16; l++)
+				{
+					__m128i v	= _mm_loadu_si128(src + l);
+					acc[2*l]	= _mm256_add_epi32(acc[2*l],	_mm256_cvtepu8_epi32(v));
+					acc[2*l+1]	= _mm256_add_epi32(acc[2*l+1],	_mm256_cvtepu8_epi32(_mm_srli_si128(v, 8)));
+				}
+			}
+			flushLanes<NC>(acc, A, sums);
+		}
+		sumTail(pixels + nbGroups*G, nbElements - nbGroups*G, NC, sums);
+	}
+
+	template<int NC>
+	void sumUInt16Kernel(const std::uint16_t *pixels, std::size_t nbPixels, std::uint64_t *sums)
+	{
+		constexpr int		G			= groupSize(NC, 16);	// elements per group (16 per load)
+		constexpr int		A			= G / 8;				// 8 x 32 bits accumulators
+		const std::size_t	nbElements	= nbPixels * NC;
+		const std::size_t	nbGroups	= nbElements / G;
+
+		std::size_t g = 0;
+		while(g < nbGroups)
+		{
+			// 32 bits lanes cannot overflow while adding up to 2^16 values of 16 bits
+			std::size_t blockEnd = std::min(nbGroups, g + (std::size_t(1) << 16));
+			__m256i acc[A];
+			for(int a = 0; a < A; a++)
+				acc[a] = _mm256_setzero_si256();
+			for(; g < blockEnd; g++)
+			{
+				const __m128i *src = reinterpret_cast<const __m128i*>(pixels + g*G);
+				for(int l = 0; l < G/16; l++)
+				{
+					acc[2*l]	= _mm256_add_epi32(acc[2*l],	_mm256_cvtepu16_epi32(_mm_loadu_si128(src + 2*l)));
+					acc[2*l+1]	= _mm256_add_epi32(acc[2*l+1],	_mm256_cvtepu16_epi32(_mm_loadu_si128(src + 2*l+1)));
+				}
+			}
+			flushLanes<NC>(acc, A, sums);
+		}
+		sumTail(pixels + nbGroups*G, nbElements - nbGroups*G, NC, sums);
+	}
+
+	// 8 halves (in the low 16 bits of each 32 bits lane) to 8 floats, without requiring F16C
+	inline __m256 halfToFloat(__m256i halves)
+	{
+		const __m256i	noSign		= _mm256_set1_epi32(0x7fff);
+		const __m256	magic		= _mm256_castsi256_ps(_mm256_set1_epi32((254 - 15) << 23));	// 2^112
+		const __m256i	wasInfNaN	= _mm256_set1_epi32(0x7bff);
+		const __m256	expInfNaN	= _mm256_castsi256_ps(_mm256_set1_epi32(255 << 23));
+
+		__m256i expMant	= _mm256_and_si256(noSign, halves);
+		__m256i sign	= _mm256_slli_epi32(_mm256_xor_si256(halves, expMant), 16);
+		__m256	scaled	= _mm256_mul_ps(_mm256_castsi256_ps(_mm256_slli_epi32(expMant, 13)), magic);
+		__m256	infNaN	= _mm256_and_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(expMant, wasInfNaN)), expInfNaN);
+		return _mm256_or_ps(scaled, _mm256_or_ps(_mm256_castsi256_ps(sign), infNaN));
+	}
+
+	template<int NC>
+	void sumHalfKernel(const std::uint16_t *pixels, std::size_t nbPixels, double *sums)
+	{
+		constexpr int		G			= groupSize(NC, 16);	// elements per group (16 per load)
+		constexpr int		A			= G / 8;				// 8 x float accumulators
+		const std::size_t	nbElements	= nbPixels * NC;
+		const std::size_t	nbGroups	= nbElements / G;
+
+		std::size_t g = 0;
+		while(g < nbGroups)
+		{
+			// flush the float lanes into double sums often enough to keep the float precision loss negligible
+			std::size_t blockEnd = std::min(nbGroups, g + 1024);
+			__m256 acc[A];
+			for(int a = 0; a < A; a++)
+				acc[a] = _mm256_setzero_ps();
+			for(; g < blockEnd; g++)
+			{
+				const __m128i *src = reinterpret_cast<const __m128i*>(pixels + g*G);
+				for(int l = 0; l < G/16; l++)
+				{
+					acc[2*l]	= _mm256_add_ps(acc[2*l],	halfToFloat(_mm256_cvtepu16_epi32(_mm_loadu_si128(src + 2*l))));
+					acc[2*l+1]	= _mm256_add_ps(acc[2*l+1],	halfToFloat(_mm256_cvtepu16_epi32(_mm_loadu_si128(src + 2*l+1))));
+				}
+			}
+			flushLanes<NC>(acc, A, sums);
+		}
+		// few elements left : same conversion on a zero padded vector
+		const std::uint16_t *tail		= pixels + nbGroups*G;
+		std::size_t			nbTail		= nbElements - nbGroups*G;
+		for(std::size_t e = 0; e < nbTail; e += 8)
+		{
+			std::uint32_t	lanes[8]	= {0, 0, 0, 0, 0, 0, 0, 0};
+			float			values[8];
+			for(std::size_t j = 0; j < 8 && e+j < nbTail; j++)
+				lanes[j] = tail[e+j];
+			_mm256_storeu_ps(values, halfToFloat(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(lanes))));
+			for(std::size_t j = 0; j < 8 && e+j < nbTail; j++)
+				sums[(e+j) % NC] += values[j];
+		}
+	}
+
+	template<int NC>
+	void sumFloatKernel(const float *pixels, std::size_t nbPixels, double *sums)
+	{
+		constexpr int		G			= groupSize(NC, 8);		// elements per group (8 per load)
+		constexpr int		A			= G / 8;				// 8 x float accumulators
+		const std::size_t	nbElements	= nbPixels * NC;
+		const std::size_t	nbGroups	= nbElements / G;
+
+		std::size_t g = 0;
+		while(g < nbGroups)
+		{
+			// flush the float lanes into double sums often enough to keep the float precision loss negligible
+			std::size_t blockEnd = std::min(nbGroups, g + 1024);
+			__m256 acc[A];
+			for(int a = 0; a < A; a++)
+				acc[a] = _mm256_setzero_ps();
+			for(; g < blockEnd; g++)
+				for(int l = 0; l < A; l++)
+					acc[l] = _mm256_add_ps(acc[l], _mm256_loadu_ps(pixels + g*G + l*8));
+			flushLanes<NC>(acc, A, sums);
+		}
+		sumTail(pixels + nbGroups*G, nbElements - nbGroups*G, NC, sums);
+	}
+}
+
+//---------------------------------------------------------------------
+
+bool ChannelKernels::avx2Built() {return true;}
+
+void ChannelKernels::sumUInt8AVX2(const std::uint8_t *pixels, std::size_t nbPixels, int nbChannels, std::uint64_t *sums)
+{
+	switch(nbChannels)
+	{
+	case 1:	return sumUInt8Kernel<1>(pixels, nbPixels, sums);
+	case 2:	return sumUInt8Kernel<2>(pixels, nbPixels, sums);
+	case 3:	return sumUInt8Kernel<3>(pixels, nbPixels, sums);
+	case 4:	return sumUInt8Kernel<4>(pixels, nbPixels, sums);
+	}
+}
+
+void ChannelKernels::sumUInt16AVX2(const std::uint16_t *pixels, std::size_t nbPixels, int nbChannels, std::uint64_t *sums)
+{
+	switch(nbChannels)
+	{
+	case 1:	return sumUInt16Kernel<1>(pixels, nbPixels, sums);
+	case 2:	return sumUInt16Kernel<2>(pixels, nbPixels, sums);
+	case 3:	return sumUInt16Kernel<3>(pixels, nbPixels, sums);
+	case 4:	return sumUInt16Kernel<4>(pixels, nbPixels, sums);
+	}
+}
+
+void ChannelKernels::sumHalfAVX2(const std::uint16_t *pixels, std::size_t nbPixels, int nbChannels, double *sums)
+{
+	switch(nbChannels)
+	{
+	case 1:	return sumHalfKernel<1>(pixels, nbPixels, sums);
+	case 2:	return sumHalfKernel<2>(pixels, nbPixels, sums);
+	case 3:	return sumHalfKernel<3>(pixels, nbPixels, sums);
+	case 4:	return sumHalfKernel<4>(pixels, nbPixels, sums);
+	}
+}
+
+void ChannelKernels::sumFloatAVX2(const float *pixels, std::size_t nbPixels, int nbChannels, double *sums)
+{
+	switch(nbChannels)
+	{
+	case 1:	return sumFloatKernel<1>(pixels, nbPixels, sums);
+	case 2:	return sumFloatKernel<2>(pixels, nbPixels, sums);
+	case 3:	return sumFloatKernel<3>(pixels, nbPixels, sums);
+	case 4:	return sumFloatKernel<4>(pixels, nbPixels, sums);
+	}
+}
+
+#else // AVX2 not enabled for this build : never selected at runtime
+
+bool ChannelKernels::avx2Built() {return false;}
+void ChannelKernels::sumUInt8AVX2	(const std::uint8_t*,	std::size_t, int, std::uint64_t*)	{}
+void ChannelKernels::sumUInt16AVX2	(const std::uint16_t*,	std::size_t, int, std::uint64_t*)	{}
+void ChannelKernels::sumHalfAVX2	(const std::uint16_t*,	std::size_t, int, double*)			{}
+void ChannelKernels::sumFloatAVX2	(const float*,			std::size_t, int, double*)			{}
+
+#endif
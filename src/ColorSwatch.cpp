@@ -5,11 +5,15 @@
 #include "MunsellColor.h"
 #include "ImagePlugin.h"
 #include "ColorSwatchMask.h"
+#include "ParallelFor.h"
+#include "DecodedImageCache.h"
+#include "DiskImageCache.h"
 
 #include <QSettings>
 #include <QDir>
 #include <QFile>
 #include <QImage>
+#include <QImageReader>
 #include <QColor>
 #include <QVector>
 #include <QMap>
@@ -18,6 +22,7 @@
 #include <stdexcept>	// exceptions ...
 #include <sstream>		// stringstream ...
 #include <algorithm>	// std::sort ...
+#include <vector>		// region buffers ...
 
 
 class ColorSwatch::Private
@@ -29,14 +34,54 @@ public:
 	QVector<ColorSwatchPatch*>			mPatchesList;
 
 	ImagePlugin* mImgPlg; // not owned by this class
+
+	int mNbWorkers;		///< threads used to measure the patches (<= 0 : one per hardware thread)
+	int mDecodeMargin;	///< < 0 : decode the whole raw image, otherwise only the patches bounding box grown by this margin (pixels)
+	bool mStreaming;	///< measure the patches from the raw image bands (never decoded) instead of the decoded image
 };
 
+namespace
+{
+	/// most used color of an image (the mask background when not provided by the settings)
+	QRgb mostFrequentRgb(const QImage &img)
+	{
+		QMap<QRgb, int> clrMap;
+		for ( int row = 0; row < img.height(); row++ )
+			for ( int col = 0; col < img.width(); col++ )
+				clrMap[img.pixel(col, row)]++;
+
+		int	maxRgbCount = 0;
+		for(auto& rgba : clrMap.keys())
+			maxRgbCount = maxRgbCount < clrMap.value(rgba) ? clrMap.value(rgba) : maxRgbCount;
+
+		return clrMap.key(maxRgbCount);
+	}
+
+	/// bounding box of all the mask pixels which are not background (the patches)
+	QRect patchesBoundingBox(const QImage &mask, QRgb bgRgb)
+	{
+		QRect bbox;
+		for ( int row = 0; row < mask.height(); row++ )
+		{
+			int first = 0, last = mask.width()-1;
+			while(first <= last && mask.pixel(first, row) == bgRgb)	first++;
+			while(last >= first && mask.pixel(last, row) == bgRgb)	last--;
+			if(first <= last)
+				bbox |= QRect(first, row, last-first+1, 1);
+		}
+		return bbox;
+	}
+}
+
 //---------------------------------------------------------------------
 //---------------------------------------------------------------------
 
 ColorSwatch::ColorSwatch(ImagePlugin* imgPlg) : d(new Private)
 {
-	d->mImgPlg	= imgPlg;
+	d->mImgPlg			= imgPlg;
+	d->mNbWorkers		= 0;
+	d->mDecodeMargin	= -1;
+	d->mStreaming		= false;
 }
 
 ColorSwatch::~ColorSwatch()
@@ -66,9 +111,58 @@ bool ColorSwatch::loadSettings(QString iniFile)
 			throw std::invalid_argument("["+FILE_LINE_FUNC_STR+"] The specified file does not exist : " + d->mRawFile.toStdString() );
 		else
 			result = true;
+
+		if(settings.childKeys().contains("workers")) // [OPTIONAL]
+		{
+			bool isInt = false;
+			int nbWorkers = settings.value("workers").toInt(&isInt);
+			if(!isInt)
+				throw std::invalid_argument("["+FILE_LINE_FUNC_STR+"] cannot read 'workers'(="+settings.value("workers").toString().toStdString()+"). Value should be an integer (<= 0 to use all hardware threads)");
+			setWorkers(nbWorkers);
+		}
+
+		if(settings.childKeys().contains("decodedCacheMB")) // [OPTIONAL]
+		{
+			bool isFloat = false;
+			float cacheMB = settings.value("decodedCacheMB").toFloat(&isFloat);
+			if(!isFloat || cacheMB < 0.0f)
+				throw std::invalid_argument("["+FILE_LINE_FUNC_STR+"] cannot read 'decodedCacheMB'(="+settings.value("decodedCacheMB").toString().toStdString()+"). Value should be a positive float (0 to disable the cache)");
+			DecodedImageCache::instance().setMaxBytes(std::size_t(double(cacheMB) * 1024.0 * 1024.0));
+		}
+
+		if(settings.childKeys().contains("diskCacheDir")) // [OPTIONAL]
+		{
+			QString diskCacheDir( settings.value("diskCacheDir").toString() );
+			DiskImageCache::instance().setDirectory( diskCacheDir.isEmpty() || !QDir::isRelativePath(diskCacheDir) ? diskCacheDir : iniFilePath.absoluteFilePath(diskCacheDir) );
+		}
+
+		if(settings.childKeys().contains("exrLayer")) // [OPTIONAL]
+		{
+			if(ImagePluginOpenEXR* exrPlg = dynamic_cast<ImagePluginOpenEXR*>(d->mImgPlg))
+				exrPlg->setLayer( settings.value("exrLayer").toString() );
+			else
+				std::cout<<"'exrLayer' setting is only used by the OpenEXR plugin."<<std::endl;
+		}
 	}
 	settings.endGroup();
 
+	// ImageCache used by the OpenImageIO plugin (shared by all the runs of this process)
+	if(settings.childGroups().contains("imagecache"))  // [OPTIONAL]
+	{
+		settings.beginGroup("imagecache");
+		bool isFloat = false, isInt = false;
+		float	maxMemoryMB	= settings.value("maxMemoryMB", 1024).toFloat(&isFloat);
+		int		autotile	= settings.value("autotile", 64).toInt(&isInt);
+		settings.endGroup();
+		if(!isFloat || !isInt)
+			throw std::invalid_argument("["+FILE_LINE_FUNC_STR+"] cannot read [imagecache] 'maxMemoryMB' (float) or 'autotile' (integer)");
+
+		if(ImagePluginOIIO* oiioPlg = dynamic_cast<ImagePluginOIIO*>(d->mImgPlg))
+			oiioPlg->useImageCache(maxMemoryMB, autotile);
+		else
+			std::cout<<"[imagecache] settings are only used by the OpenImageIO plugin."<<std::endl;
+	}
+
 	// Load mask info
 	d->mMask.reset();
 	if(settings.childGroups().contains("mask"))  // [OPTIONAL]
@@ -96,6 +190,21 @@ bool ColorSwatch::loadSettings(QString iniFile)
 				d->mMask->backgroundColor(bgColor);
 		}
 
+		if(settings.childKeys().contains("decodeMargin") && d->mMask) // [OPTIONAL]
+		{
+			bool isInt = false;
+			int margin = settings.value("decodeMargin").toInt(&isInt);
+			if(!isInt)
+				throw std::invalid_argument("["+FILE_LINE_FUNC_STR+"] cannot read 'decodeMargin'(="+settings.value("decodeMargin").toString().toStdString()+"). Value should be an integer (< 0 to decode the whole image)");
+			setDecodeMargin(margin);
+		}
+
+		if(settings.childKeys().contains("streaming") && d->mMask) // [OPTIONAL]
+		{
+			QString streaming = settings.value("streaming").toString();
+			setStreaming( streaming.contains("ON",Qt::CaseInsensitive) || streaming.contains("true",Qt::CaseInsensitive) || streaming.contains("1",Qt::CaseInsensitive) );
+		}
+
 		if(settings.childKeys().contains("applyAlphaMask") && d->mMask) // [OPTIONAL]
 		{
 			QString outApplied = settings.value("applyAlphaMask").toString();
@@ -174,59 +283,146 @@ bool ColorSwatch::loadSettings(QString iniFile)
 
 bool ColorSwatch::loadImages()
 {
-	bool result = false;
+	return openImages() && decodeImages();
+}
 
-	// apply settings by loading images
-	if( !d->mRawFile.isEmpty() )
+//---------------------------------------------------------------------
+
+bool ColorSwatch::openImages()
+{
+	if( d->mRawFile.isEmpty() )
+		throw std::invalid_argument("["+FILE_LINE_FUNC_STR+"] No raw image filename provided!");
+	if( !d->mMask )
+		throw std::invalid_argument("["+FILE_LINE_FUNC_STR+"] No mask img provided!");
+
+	// check the raw image / mask pairing from the files headers only (before decoding any pixels)
+	ImagePlugin::ImageInfo info = d->mImgPlg->probe(d->mRawFile);
+	if( !info.isValid() )
+		throw std::logic_error("["+FILE_LINE_FUNC_STR+"] Cannot probe raw image!");
+	std::cout<<"Raw image: "<<info<<std::endl;
+
+	QSize img	(info.width, info.height);
+	QSize mask	(QImageReader(d->mMask->getImageFilePathName()).size());
+	if(img != mask)
+	{
+		QString imgResl		= QString("img(%1,%2)").arg(img.width()).arg(img.height());
+		QString imaskResl	= QString("mask(%1,%2)").arg(mask.width()).arg(mask.height());
+		QString resolComp	= QString("%1 vs %2").arg(imgResl).arg(imaskResl);
+		std::cerr<<resolComp.toStdString()<<std::endl;
+		throw std::length_error("["+FILE_LINE_FUNC_STR+"]Image file and mask image haven't the same size! ");
+	}
+
+	// apply settings by loading images (headers only for the raw image)
+	if( !d->mImgPlg->loadImage(d->mRawFile) )
+		throw std::logic_error("["+FILE_LINE_FUNC_STR+"] Cannot load raw image!");
+	if( !d->mMask->loadImage() )
+		throw std::invalid_argument("["+FILE_LINE_FUNC_STR+"] Mask image cannot be loaded!");
+
+	return true;
+}
+
+//---------------------------------------------------------------------
+
+bool ColorSwatch::decodeImages()
+{
+	if( !d->mMask || d->mImgPlg->loadState() == ImagePlugin::LoadState::Unopened )
+		throw std::logic_error("["+FILE_LINE_FUNC_STR+"] Cannot decode before openImages!");
+
+	// streaming : the patches are measured from the file bands, nothing to decode (nor to apply the mask on)
+	if( d->mStreaming )
+	{
+		if( d->mMask->apllyAlphaMask() )
+			std::cout<<"Mask not applied to the image in streaming mode."<<std::endl;
+		return true;
+	}
+
+	// decode once here: the patches measurement only use the const (thread-safe) read methods
+	bool isDecoded = false;
+	if( d->mDecodeMargin >= 0 )
 	{
-		if(result = d->mImgPlg->loadImage(d->mRawFile))
+		QImage	mask	= d->mMask->getImage();
+		QRgb	bgRgb	= d->mMask->haveBackgroundColor() ? d->mMask->backgroundColor().rgba() : mostFrequentRgb(mask);
+		QRect	bbox	= patchesBoundingBox(mask, bgRgb);
+		if( bbox.isEmpty() ) // no patch in the mask : nothing to restrict the decode to
 		{
-			if(d->mMask)
-			{
-				if( d->mMask->loadImage() )
-				{
-					QSize img	(d->mImgPlg->size().width(),			d->mImgPlg->size().height());
-					QSize mask	(d->mMask->getImage().size().width(),	d->mMask->getImage().size().height());
-					if(img != mask)
-					{
-						QString imgResl		= QString("img(%1,%2)").arg(img.width()).arg(img.height());
-						QString imaskResl	= QString("mask(%1,%2)").arg(mask.width()).arg(mask.height());
-						QString resolComp	= QString("%1 vs %2").arg(imgResl).arg(imaskResl);
-						std::cerr<<resolComp.toStdString()<<std::endl;
-						throw std::length_error("["+FILE_LINE_FUNC_STR+"]Image file and mask image haven't the same size! ");
-					}
-					else if( result && d->mMask->apllyAlphaMask() )
-					{
-						if(!d->mMask->applyMask( &d->mImgPlg->toQImage() ) )
-						{
-							writeImage2QImage();
-							throw std::logic_error("["+FILE_LINE_FUNC_STR+"] Mask aplication FAILED...");
-						}
-						else
-							std::cout<<"Mask loaded and applied it to the image."<<std::endl;
-					}
-					std::cout<<"Mask loaded wihtout applying it to the image."<<std::endl;
-				}
-				else
-					throw std::invalid_argument("["+FILE_LINE_FUNC_STR+"] Mask image cannot be loaded!");
-			}
-			else
-				throw std::invalid_argument("["+FILE_LINE_FUNC_STR+"] No mask img provided!");
+			std::cerr<<"WARNING: ["+FILE_LINE_FUNC_STR+"] No patch found in the mask, decode the whole raw image."<<std::endl;
+			isDecoded = d->mImgPlg->decode();
+		}
+		else
+		{
+			QRect roi = bbox.adjusted(-d->mDecodeMargin, -d->mDecodeMargin, d->mDecodeMargin, d->mDecodeMargin);
+			std::cout<<"Decode raw image region ("<<roi.x()<<","<<roi.y()<<") "<<roi.width()<<"x"<<roi.height()<<std::endl;
+			isDecoded = d->mImgPlg->decodeRegion(roi);
+		}
+	}
+	else
+		isDecoded = d->mImgPlg->decode();
+	if( !isDecoded )
+		throw std::logic_error("["+FILE_LINE_FUNC_STR+"] Cannot decode raw image!");
+
+	if( d->mMask->apllyAlphaMask() )
+	{
+		if(!d->mMask->applyMask( &d->mImgPlg->toQImage() ) )
+		{
+			writeImage2QImage();
+			throw std::logic_error("["+FILE_LINE_FUNC_STR+"] Mask aplication FAILED...");
 		}
 		else
-			throw std::logic_error("["+FILE_LINE_FUNC_STR+"] Cannot load raw image!");
+			std::cout<<"Mask loaded and applied it to the image."<<std::endl;
 	}
 	else
-		throw std::invalid_argument("["+FILE_LINE_FUNC_STR+"] No raw image filename provided!");
-	
-	if(!result)
-		d->mMask.reset();
+		std::cout<<"Mask loaded wihtout applying it to the image."<<std::endl;
 
-	return result;
+	return true;
 }
 
 //---------------------------------------------------------------------
 
+void ColorSwatch::setWorkers(int nbWorkers)
+{
+	d->mNbWorkers = nbWorkers;
+}
+
+int ColorSwatch::workers() const
+{
+	return d->mNbWorkers;
+}
+
+void ColorSwatch::setDecodeMargin(int margin)
+{
+	d->mDecodeMargin = margin;
+}
+
+int ColorSwatch::decodeMargin() const
+{
+	return d->mDecodeMargin;
+}
+
+void ColorSwatch::setStreaming(bool streaming)
+{
+	d->mStreaming = streaming;
+}
+
+bool ColorSwatch::streaming() const
+{
+	return d->mStreaming;
+}
+
+void ColorSwatch::setApplyMask(bool apply)
+{
+	if(d->mMask)
+		d->mMask->apllyAlphaMask(apply);
+}
+
+void ColorSwatch::setWriteMaskImages(bool write)
+{
+	if(d->mMask)
+	{
+		d->mMask->outputAplliedMask(write);
+		d->mMask->outputPatches(write);
+	}
+}
+
 QString ColorSwatch::rawFilePathName() const
 {
 	return d->mRawFile;
@@ -252,6 +448,14 @@ QImage ColorSwatch::getMaskImg() const
 	return d->mMask->getImage();
 }
 
+QVector<QRect> ColorSwatch::patchesRects() const
+{
+	QVector<QRect> rects;
+	for(ColorSwatchPatch* patch : d->mPatchesList)
+		rects.push_back(patch->getRect());
+	return rects;
+}
+
 QString ColorSwatch::printPatchesInfo() const
 {
 	std::stringstream ss;
@@ -281,6 +485,13 @@ std::ostream& operator<<(std::ostream& stream, const ColorSwatch &colorSwatch)
 //---------------------------------------------------------------------
 
 bool ColorSwatch::fillPatchesPixelsFromMask()
+{
+	return extractPatchesFromMask() && measurePatches();
+}
+
+//---------------------------------------------------------------------
+
+bool ColorSwatch::extractPatchesFromMask()
 {
 	bool result = false;
 	if(!d->mMask)
@@ -288,17 +499,7 @@ bool ColorSwatch::fillPatchesPixelsFromMask()
 	
 
 	// try to auto detect background color
-	QMap<QRgb, int> clrMap;
-	for ( int row = 0; row < d->mMask->getImage().height(); row++ )
-		for ( int col = 0; col < d->mMask->getImage().width(); col++ )
-			if(d->mMask->getImage().valid(col,row))
-				clrMap[d->mMask->getImage().pixel(col, row)]++;
-
-	int	maxRgbCount = 0;
-	for(auto& rgba : clrMap.keys())
-		maxRgbCount = maxRgbCount < clrMap.value(rgba) ? clrMap.value(rgba) : maxRgbCount;
-
-	QRgb maxRgba = clrMap.key(maxRgbCount);
+	QRgb maxRgba = mostFrequentRgb(d->mMask->getImage());
 	if( !d->mMask->haveBackgroundColor() )	
 		d->mMask->backgroundColor( QColor(maxRgba) );
 	else if(QRgb curBgRgba = d->mMask->backgroundColor().rgba() != maxRgba)
@@ -315,7 +516,9 @@ bool ColorSwatch::fillPatchesPixelsFromMask()
 		{}
 		QImage* mImg;
 		QRgb	mAverage;
+		float	mAverageF[4];	///< streaming mode channels averages
 		int		mRelPixXbegin , mRelPixYbegin;
+		ImagePlugin::pixelSpans mSpans; ///< runs of mask pixels belonging to this patch (in the mask/raw image pixel coord system)
 	};
 	QVector<Patch*> patches;
 	QRgb			bgRgb = d->mMask->backgroundColor().rgba();
@@ -336,29 +539,56 @@ bool ColorSwatch::fillPatchesPixelsFromMask()
 					while ( mask.pixel(col		, maxRow) != bgRgb ) { maxRow++; }
 					while ( mask.pixel(maxCol	, row	) != bgRgb ) { maxCol++; }
 					QImage* patchImg = new QImage( maxCol-col, maxRow-row,QImage::Format_RGB32);
+
+					// read the whole patch region from the SDK image at once (RGB interleaved) instead of one call per pixel channel
+					// (streaming : only the patch geometry here, its pixels are measured with all the others from the file bands)
+					QRect				patchRect(col, row, maxCol-col, maxRow-row);
+					std::vector<float>	patchPixels;
+					if(d->mStreaming)
+						patchImg->fill(Qt::black);
+					else
+					{
+						patchPixels.resize(size_t(patchRect.width()) * size_t(patchRect.height()) * 3);
+						if(!d->mImgPlg->readRegion(patchRect, patchPixels.data(), 3))
+							throw std::runtime_error("["+FILE_LINE_FUNC_STR+"] Cannot read patch region from the SDK image!");
+					}
+
 					float somRed = 0.0f, somGreen = 0.0f, somBlue = 0.0f, somAlpha = 0.0f;
 					int nbPixels = 0;
+					ImagePlugin::pixelSpans spans;
 					for(int r=0, localRow = row; localRow < maxRow; localRow++, r++ )
 					{
+						int spanBegin = -1;
 						for(int c=0, localCol = col; localCol < maxCol; localCol++, c++ )
 						{
 							QRgb val = mask.pixel(localCol, localRow);
+							if( val == bgRgb && spanBegin >= 0 )
+							{
+								spans.push_back( ImagePlugin::PixelSpan(localRow, spanBegin, localCol) );
+								spanBegin = -1;
+							}
 							if( val != bgRgb ) // in case the mask is not really an aligned square
 							{
+								if( spanBegin < 0 )
+									spanBegin = localCol;
 								//somRed	 += qRed(val);
 								//somGreen += qGreen(val);
 								//somBlue	 += qBlue(val);
 								//somAlpha += qAlpha(val);
 
 								nbPixels ++;
-								float pixRed = d->mImgPlg->readSinglePixelChannel(localCol, localRow, 0);
-								somRed += pixRed;
-
-								float pixGreen = d->mImgPlg->readSinglePixelChannel(localCol, localRow, 1);
-								somGreen += pixGreen;
-
-								float pixBlue = d->mImgPlg->readSinglePixelChannel(localCol, localRow, 2);
-								somBlue += pixBlue; 
+								if(d->mStreaming)
+								{
+									mask.setPixel(localCol, localRow, bgRgb);
+									continue;
+								}
+								const float* pix = &patchPixels[(size_t(r) * patchRect.width() + c) * 3];
+								float pixRed	= pix[0];
+								float pixGreen	= pix[1];
+								float pixBlue	= pix[2];
+								somRed		+= pixRed;
+								somGreen	+= pixGreen;
+								somBlue		+= pixBlue;
 
 								QColor clr;
 								clr.setRedF(pixRed);
@@ -371,12 +601,15 @@ bool ColorSwatch::fillPatchesPixelsFromMask()
 								mask.setPixel(localCol, localRow, bgRgb);
 							}
 						}
+						if( spanBegin >= 0 )
+							spans.push_back( ImagePlugin::PixelSpan(localRow, spanBegin, maxCol) );
 					}
 					QRgb patchRgbaAverage = qRgba((somRed/nbPixels)*255.0f, (somGreen/nbPixels)*255.0f, (somBlue/nbPixels)*255.0f, (somAlpha/nbPixels)*255.0f);
 					patches.push_back( new Patch(patchImg, patchRgbaAverage, col, row) );
+					patches.last()->mSpans.swap(spans);
 
-					// save patch QImage in order of detection
-					if(d->mMask->outputPatches())
+					// save patch QImage in order of detection (streaming : once measured below, it is still black here)
+					if(d->mMask->outputPatches() && !d->mStreaming)
 					{
 						QString patchFile = QString("patch_%1.png").arg(i++);
 						patchImg->save(patchFile);
@@ -388,6 +621,33 @@ bool ColorSwatch::fillPatchesPixelsFromMask()
 	}
 
 
+	// streaming : all the patches measured in one pass over the raw image bands (only one band in memory at a time)
+	if(d->mStreaming)
+	{
+		std::vector<ImagePlugin::pixelSpans> spansLists;
+		for(Patch* patch : patches)
+			spansLists.push_back(patch->mSpans);
+		std::vector<float> averages;
+		if(!d->mImgPlg->streamAveragesChannels(spansLists, averages))
+			throw std::runtime_error("["+FILE_LINE_FUNC_STR+"] Cannot stream the patches averages from the SDK image!");
+		for(int i=0; i<patches.size(); i++)
+		{
+			std::copy(&averages[4*i], &averages[4*i+4], patches[i]->mAverageF);
+			QColor clr;
+			clr.setRgbF(qBound(0.0f, averages[4*i], 1.0f), qBound(0.0f, averages[4*i+1], 1.0f), qBound(0.0f, averages[4*i+2], 1.0f));
+			patches[i]->mAverage = qRgba(clr.red(), clr.green(), clr.blue(), 0);
+			patches[i]->mImg->fill(clr.rgb());
+
+			// patches are still in order of detection here
+			if(d->mMask->outputPatches())
+			{
+				QString patchFile = QString("patch_%1.png").arg(i);
+				patches[i]->mImg->save(patchFile);
+				std::cout<<"Saved patch (in order of detection):"<<patchFile.toStdString()<<" ["<<patches[i]->mImg->width()<<"x"<<patches[i]->mImg->height()<<"]"<<std::endl;
+			}
+		}
+	}
+
 	// try to relie list of the local mask patches with the ColorSwatchPatch list
 	std::sort(patches.begin(), patches.end(), [](Patch* lhs, Patch* rhs) 
 		{
@@ -403,23 +663,76 @@ bool ColorSwatch::fillPatchesPixelsFromMask()
 
 	for(int i=0; i<patches.size(); i++)
 		if(d->mPatchesList.size() >= i)
+		{
 			d->mPatchesList[i]->setImage(patches[i]->mImg, patches[i]->mRelPixXbegin, patches[i]->mRelPixYbegin);
+			d->mPatchesList[i]->setPixelSpans(patches[i]->mSpans);
+			if(d->mStreaming)
+				d->mPatchesList[i]->setAverageRGBpixel(patches[i]->mAverageF[0], patches[i]->mAverageF[1], patches[i]->mAverageF[2], patches[i]->mAverageF[3]);
+		}
 
 	patches.clear();
 
+	return result = true;
+}
+
+//---------------------------------------------------------------------
+
+bool ColorSwatch::measurePatches()
+{
+	bool result = false;
+
+	// streaming : already measured with the patches extraction
+	if(d->mStreaming)
+		return result = true;
 
 	// compute averages pixels (but this time) using the SDK img provided and directly from the raw img pixels coords
 	if(!d->mImgPlg)
 		throw std::logic_error("["+FILE_LINE_FUNC_STR+"] Cannot computeAverageRGBpixel since SDK image is not available!");
 
-	for(ColorSwatchPatch* patch : d->mPatchesList)
-		patch->computeAverageRGBpixel(d->mImgPlg);
+	// patches are independent : each worker measures whole patches (ImagePlugin read methods are const and thread-safe once decoded)
+	std::vector<char> patchResults(d->mPatchesList.size(), 0);
+	parallelFor(d->mPatchesList.size(), d->mNbWorkers, [this, &patchResults](int p)
+		{
+			patchResults[p] = d->mPatchesList[p]->computeAverageRGBpixel(d->mImgPlg) ? 1 : 0;
+		}
+	);
+
+	if(std::find(patchResults.begin(), patchResults.end(), 0) != patchResults.end())
+		std::cerr<<"WARNING: ["+FILE_LINE_FUNC_STR+"] Some patches averages could not be computed."<<std::endl;
 
 	return result = true;
 }
 
 //---------------------------------------------------------------------
 
+std::vector<ImagePlugin::pixelSpans> ColorSwatch::patchesSpans() const
+{
+	std::vector<ImagePlugin::pixelSpans> spansLists;
+	for(ColorSwatchPatch* patch : d->mPatchesList)
+		spansLists.push_back(patch->getPixelSpans());
+	return spansLists;
+}
+
+void ColorSwatch::setPatchesSpans(const std::vector<ImagePlugin::pixelSpans> &spansLists)
+{
+	if(int(spansLists.size()) != d->mPatchesList.size())
+		throw std::length_error("["+FILE_LINE_FUNC_STR+"] Provided patches geometry is not equal to number of provided patches reflectance ("+(int(spansLists.size()) < d->mPatchesList.size() ? "<)" : ">)") );
+
+	for(int i=0; i<d->mPatchesList.size(); i++)
+	{
+		// the patch image only keeps its bounding box here (the pixels are measured by measurePatches)
+		QRect bbox;
+		for(const ImagePlugin::PixelSpan &span : spansLists[i])
+			bbox |= QRect(span.xBegin, span.row, span.width(), 1);
+		QImage patchImg(bbox.size(), QImage::Format_RGB32);
+		patchImg.fill(Qt::black);
+		d->mPatchesList[i]->setImage(&patchImg, bbox.x(), bbox.y());
+		d->mPatchesList[i]->setPixelSpans(spansLists[i]);
+	}
+}
+
+//---------------------------------------------------------------------
+
 ColorSwatch::GraphData2D ColorSwatch::getGraphData(DATA datalist)
 {
 	GraphData2D data;
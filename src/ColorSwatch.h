@@ -1,9 +1,12 @@
 #pragma once
 #include <QString>
 #include <QImage>
+#include <QRect>
+#include <QVector>
 #include <iostream>
+#include <vector>
 
-class ImagePlugin;
+#include "ImagePlugin.h"
 
 class ColorSwatch
 {
@@ -26,19 +29,57 @@ public:
 	/// apply (overlay) it/on the raw image to get filled mask
 	bool loadImages();
 
+	/// the two steps of loadImages, usable separately to show a preview of the raw image before decoding it
+	/// (openImages checks the raw image / mask pairing and loads their headers, decodeImages decodes the raw image and applies the mask)
+	bool openImages();
+	bool decodeImages();
+
 	/// when mask image loaded, try to extract patches samples (pixel origin, pixels content, channels averages)
 	/// from defined (or autodetected background) and fill colorSwatchPatch data structure
 	/// (averages are only used to get the right patches order but since it is computed by Qt, we don't fill it into colorSwatchPatch)
 	bool fillPatchesPixelsFromMask();
 
+	/// the two steps of fillPatchesPixelsFromMask, usable separately to report the patches geometry before measuring them
+	/// (extractPatchesFromMask sets the patches geometry and preview images, measurePatches computes their averages)
+	bool extractPatchesFromMask();
+	bool measurePatches();
+
+	/// patches geometry (runs of raw image pixels, in the patches reflectances order) once extracted from the mask
+	std::vector<ImagePlugin::pixelSpans> patchesSpans() const;
+	/// reuse the patches geometry extracted by an other ColorSwatch of the same settings instead of extractPatchesFromMask
+	/// (e.g. measure the same chart with several image plugins), throw if the number of patches differs
+	void setPatchesSpans(const std::vector<ImagePlugin::pixelSpans> &spansLists);
+
 	///
 	GraphData2D getGraphData(DATA datalist);
 
+	/// number of threads measuring the patches in fillPatchesPixelsFromMask (<= 0 : one per hardware thread, default)
+	/// can also be set with the optional 'workers' key of the [colorswatch] ini section
+	void	setWorkers(int nbWorkers);
+	int		workers()				const;
+
+	/// margin (pixels) around the mask patches bounding box : when >= 0, loadImages only decode this region of the raw image
+	/// (< 0 : decode the whole image, default). Can also be set with the optional 'decodeMargin' key of the [mask] ini section
+	void	setDecodeMargin(int margin);
+	int		decodeMargin()			const;
+
+	/// streaming measurement (images larger than memory) : the raw image is never decoded, the patches are measured
+	/// in one pass over the file bands by ImagePlugin::streamAveragesChannels (default false, ignore decodeMargin and the mask application).
+	/// Can also be set with the optional 'streaming' key of the [mask] ini section
+	void	setStreaming(bool streaming);
+	bool	streaming()				const;
+
+	/// mask application on the decoded image and debug images writes (applied mask, patches) loaded from the [mask] ini section :
+	/// turn them off after loadSettings when only the patches are measured (e.g. several ColorSwatch running in parallel)
+	void	setApplyMask(bool apply);
+	void	setWriteMaskImages(bool write);
+
 public:
 	QString rawFilePathName()		const;
 	bool	haveImage()				const;
 	bool	haveMask()				const;
 	QImage	getMaskImg()			const;
+	QVector<QRect> patchesRects()	const; ///< patches bounding boxes (raw image pixel coord system) once extracted from the mask
 	QImage	getQImage()				const;
 	QString printPatchesInfo()		const;
 	QString printMaskInfo()			const;
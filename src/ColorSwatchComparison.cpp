@@ -0,0 +1,210 @@
+#include "ColorSwatchComparison.h"
+
+#include <QMetaType>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <exception>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <sstream>
+#include <thread>
+#include <typeindex>
+#include <typeinfo>
+
+class ColorSwatchComparison::Private
+{
+public:
+	/// chart measured by one plugin
+	struct Result
+	{
+		Result() : isReference(false), isMeasured(false), seconds(0.0) {}
+
+		QString						name;
+		bool						isReference;
+		bool						isMeasured;
+		QString						error;
+		double						seconds;	///< settings, decode and measurement time
+		ColorSwatch::GraphData2D	graphs[3];	///< R,G,B patches averages (x : patches reflectances)
+	};
+
+	Private(const std::type_index &referenceType) : mReferenceType(referenceType) {}
+
+	void	measure(const ImagePlugin::Factory &factory, int nbWorkers, ImagePlugin::ProgressCallback progress, Result &result) const;
+	QString	deltasTable(const std::vector<Result> &results, int reference) const;
+
+	std::vector<ImagePlugin::pixelSpans>	mSpansLists;
+	std::type_index							mReferenceType;
+	QString									mIniFile;
+	ImagePlugin::ProgressCallback			mProgress;
+};
+
+//---------------------------------------------------------------------
+
+void ColorSwatchComparison::Private::measure(const ImagePlugin::Factory &factory, int nbWorkers, ImagePlugin::ProgressCallback progress, Result &result) const
+{
+	auto start = std::chrono::steady_clock::now();
+	try
+	{
+		std::unique_ptr<ImagePlugin> imgPlg(factory());
+		imgPlg->setProgressCallback(progress);
+		result.isReference = std::type_index(typeid(*imgPlg)) == mReferenceType;
+
+		// each plugin gets its own ColorSwatch : the plugin specific settings (colorspace, caches, layer...) are applied by loadSettings
+		ColorSwatch colorSwatch(imgPlg.get());
+		if( colorSwatch.loadSettings(mIniFile) )
+		{
+			colorSwatch.setStreaming(false);		// the plugins are compared on their decoded images
+			colorSwatch.setWorkers(nbWorkers);		// the hardware threads are shared by all the plugins
+			colorSwatch.setApplyMask(false);		// only the shared patches spans are measured
+			colorSwatch.setWriteMaskImages(false);	// the plugins threads would write the same files
+			if( colorSwatch.openImages() && colorSwatch.decodeImages() )
+			{
+				colorSwatch.setPatchesSpans(mSpansLists);
+				if( result.isMeasured = colorSwatch.measurePatches() )
+				{
+					result.graphs[0] = colorSwatch.getGraphData(ColorSwatch::DATA::R);
+					result.graphs[1] = colorSwatch.getGraphData(ColorSwatch::DATA::G);
+					result.graphs[2] = colorSwatch.getGraphData(ColorSwatch::DATA::B);
+				}
+			}
+		}
+		if(!result.isMeasured)
+			result.error = "cannot load or decode the raw image";
+	}
+	catch(std::exception &e) { result.error = QString(e.what()); result.isMeasured = false; }
+	result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+QString ColorSwatchComparison::Private::deltasTable(const std::vector<Result> &results, int reference) const
+{
+	const char*			channels[3]	= {"R", "G", "B"};
+	const Result		&ref		= results[reference];
+	std::stringstream	ss;
+	ss<<std::fixed<<std::setprecision(5);
+
+	ss<<"Image plugins comparison on "<<mSpansLists.size()<<" patches (reference : "<<ref.name.toStdString()<<", deltas = plugin - reference) :\n";
+	for(const Result &result : results)
+	{
+		ss<<"\t"<<std::setw(16)<<std::left<<result.name.toStdString()<<std::right;
+		if(!result.isMeasured)
+		{
+			ss<<"FAILED ("<<result.error.toStdString()<<")\n";
+			continue;
+		}
+		ss<<"measured in "<<std::setprecision(2)<<result.seconds<<"s"<<std::setprecision(5);
+		if(&result != &ref)
+		{
+			ss<<"\tmax |delta|";
+			for(int c = 0; c < 3; c++)
+			{
+				double maxDelta = 0.0;
+				for(int i = 0; i < ref.graphs[c].second.size(); i++)
+					maxDelta = std::max(maxDelta, std::fabs(result.graphs[c].second[i] - ref.graphs[c].second[i]));
+				ss<<" "<<channels[c]<<" "<<maxDelta;
+			}
+		}
+		ss<<"\n";
+	}
+
+	for(int i = 0; i < ref.graphs[0].second.size(); i++)
+	{
+		ss<<"Patch ["<<i<<"] ("<<std::setprecision(2)<<ref.graphs[0].first[i]<<"% reflectance) :"<<std::setprecision(5)<<"\n";
+		for(const Result &result : results)
+		{
+			if(!result.isMeasured)
+				continue;
+			ss<<"\t"<<std::setw(16)<<std::left<<result.name.toStdString()<<std::right;
+			for(int c = 0; c < 3; c++)
+			{
+				if(&result == &ref)
+					ss<<" "<<channels[c]<<" "<<ref.graphs[c].second[i];
+				else
+					ss<<" d"<<channels[c]<<" "<<std::showpos<<result.graphs[c].second[i] - ref.graphs[c].second[i]<<std::noshowpos;
+			}
+			ss<<"\n";
+		}
+	}
+	return QString(ss.str().c_str());
+}
+
+//---------------------------------------------------------------------
+
+ColorSwatchComparison::ColorSwatchComparison(const ColorSwatch &reference, const ImagePlugin* referencePlugin, QString iniFile,
+	ImagePlugin::ProgressCallback progress, QObject *parent)
+	: QObject(parent)
+	, d(new Private(std::type_index(typeid(*referencePlugin))))
+{
+	d->mSpansLists	= reference.patchesSpans();
+	d->mIniFile		= iniFile;
+	d->mProgress	= progress;
+
+	// signals arguments are queued to the GUI thread
+	qRegisterMetaType<ColorSwatch::GraphData2D>("ColorSwatch::GraphData2D");
+}
+
+ColorSwatchComparison::~ColorSwatchComparison()
+{
+	delete d;
+}
+
+//---------------------------------------------------------------------
+
+void ColorSwatchComparison::run()
+{
+	std::vector< std::pair<QString, ImagePlugin::Factory> > plugins = ImagePlugin::registeredPlugins();
+	std::vector<Private::Result>	results(plugins.size());
+	std::vector<float>				pluginsDone(plugins.size(), 0.0f);
+	std::mutex						doneMutex;
+
+	// one thread per plugin (decode and measurement), the hardware threads left measure the patches of each one
+	int nbWorkers = std::max(1, int(std::thread::hardware_concurrency()) / int(plugins.size()));
+	std::vector<std::thread> threads;
+	for(std::size_t p = 0; p < plugins.size(); p++)
+	{
+		results[p].name = plugins[p].first;
+		ImagePlugin::ProgressCallback progress = [this, p, &pluginsDone, &doneMutex](float done)
+			{
+				float meanDone = 0.0f;
+				{
+					std::lock_guard<std::mutex> lock(doneMutex);
+					pluginsDone[p]	= done;
+					meanDone		= std::accumulate(pluginsDone.begin(), pluginsDone.end(), 0.0f) / float(pluginsDone.size());
+				}
+				return d->mProgress ? d->mProgress(meanDone) : false;
+			};
+		threads.push_back( std::thread([this, p, nbWorkers, progress, &plugins, &results]()
+			{
+				Private::Result &result = results[p];
+				d->measure(plugins[p].second, nbWorkers, progress, result);
+				progress(1.0f);
+				if(result.isMeasured)
+					emit pluginMeasured(result.name, result.graphs[0], result.graphs[1], result.graphs[2]);
+			}
+		) );
+	}
+	for(std::thread &thread : threads)
+		thread.join();
+
+	// deltas against the plugin of the reference type, or the first measured one if it failed
+	int reference = -1, nbMeasured = 0;
+	QString error;
+	for(std::size_t p = 0; p < results.size(); p++)
+	{
+		if(!results[p].isMeasured)
+		{
+			error += results[p].name + " : " + results[p].error + "\n";
+			continue;
+		}
+		nbMeasured++;
+		if(reference < 0 || (results[p].isReference && !results[reference].isReference))
+			reference = int(p);
+	}
+
+	if(reference >= 0)
+		emit deltasReady( d->deltasTable(results, reference) );
+	emit finished(nbMeasured >= 2, error.trimmed());
+}
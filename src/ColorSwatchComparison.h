@@ -0,0 +1,39 @@
+#pragma once
+
+#include "ColorSwatch.h"
+#include "ImagePlugin.h"
+
+#include <QObject>
+#include <QString>
+
+#include <vector>
+
+/// Measure a same chart with every registered image plugin (ImagePlugin::registeredPlugins) in one run :
+/// each plugin decodes the raw image of the settings in its own thread and measures the patches geometry extracted once
+/// by the reference ColorSwatch, then the per patch deltas of each plugin against the reference plugin are reported.
+/// Move it to a QThread and start run() (like ColorSwatchLoader), the reference ColorSwatch is only read in the constructor.
+class ColorSwatchComparison : public QObject
+{
+	Q_OBJECT
+public:
+	/// reference : ColorSwatch loaded from iniFile (patches extracted) with the referencePlugin (the deltas are computed against its type)
+	/// progress : called from the plugins threads with the mean done portion [0-1] of all the plugins, returning true cancel the run
+	ColorSwatchComparison(const ColorSwatch &reference, const ImagePlugin* referencePlugin, QString iniFile,
+		ImagePlugin::ProgressCallback progress = ImagePlugin::ProgressCallback(), QObject *parent = 0);
+	virtual ~ColorSwatchComparison();
+
+public slots:
+	void run();
+
+signals:
+	void pluginMeasured	(const QString &plugin,
+						 ColorSwatch::GraphData2D graphR,
+						 ColorSwatch::GraphData2D graphG,
+						 ColorSwatch::GraphData2D graphB );	///< emitted by each plugin thread once its patches are measured
+	void deltasReady	(const QString &table);				///< per patch channels deltas of each plugin against the reference plugin
+	void finished		(bool isCompared, const QString &error);	///< always emitted last (error lists the plugins that failed)
+
+private:
+	class Private;
+	Private *d;
+};
@@ -0,0 +1,77 @@
+#include "ColorSwatchLoader.h"
+
+#include "ImagePlugin.h"
+
+#include <QMetaType>
+
+#include <exception>
+
+class ColorSwatchLoader::Private
+{
+public:
+	std::shared_ptr<ColorSwatch>	mColorSwatch;
+	ImagePlugin*					mImgPlg;
+	QString							mIniFile;
+	QSize							mPreviewSize;
+};
+
+//---------------------------------------------------------------------
+
+ColorSwatchLoader::ColorSwatchLoader(std::shared_ptr<ColorSwatch> colorSwatch, ImagePlugin* imgPlg, QString iniFile, QSize previewSize, QObject *parent)
+	: QObject(parent)
+	, d(new Private)
+{
+	d->mColorSwatch	= colorSwatch;
+	d->mImgPlg		= imgPlg;
+	d->mIniFile		= iniFile;
+	d->mPreviewSize	= previewSize;
+
+	// signals arguments are queued to the GUI thread
+	qRegisterMetaType<ColorSwatch::GraphData2D>("ColorSwatch::GraphData2D");
+	qRegisterMetaType< QVector<QRect> >("QVector<QRect>");
+}
+
+ColorSwatchLoader::~ColorSwatchLoader()
+{
+	delete d;
+}
+
+//---------------------------------------------------------------------
+
+void ColorSwatchLoader::run()
+{
+	bool	isLoaded = false;
+	QString error;
+	try
+	{
+		if( isLoaded = d->mColorSwatch->loadSettings(d->mIniFile) )
+		{
+			if( isLoaded = d->mColorSwatch->openImages() )
+			{
+				emit previewReady( d->mImgPlg->preview(d->mPreviewSize) );
+
+				if( isLoaded = d->mColorSwatch->decodeImages() )
+				{
+					if( !d->mColorSwatch->streaming() ) // the image is never decoded in streaming mode (the preview stays)
+						emit imageReady( d->mColorSwatch->getQImage() );
+
+					if( isLoaded = d->mColorSwatch->extractPatchesFromMask() )
+					{
+						emit patchesReady( d->mColorSwatch->patchesRects(), d->mColorSwatch->getMaskImg().size() );
+
+						isLoaded = d->mColorSwatch->measurePatches();
+						emit graphReady(d->mColorSwatch->getGraphData(ColorSwatch::DATA::REF),
+							d->mColorSwatch->getGraphData(ColorSwatch::DATA::R),
+							d->mColorSwatch->getGraphData(ColorSwatch::DATA::G),
+							d->mColorSwatch->getGraphData(ColorSwatch::DATA::B),
+							d->mColorSwatch->getGraphData(ColorSwatch::DATA::A)
+						);
+					}
+				}
+			}
+		}
+	}
+	catch(std::exception &e) { error = QString(e.what()); isLoaded = false; }
+
+	emit finished(isLoaded, error);
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "ColorSwatch.h"
+
+#include <QObject>
+#include <QImage>
+#include <QRect>
+#include <QSize>
+#include <QString>
+#include <QVector>
+
+#include <memory>
+
+class ImagePlugin;
+
+/// Run the ColorSwatch loading stages (settings, raw image preview, decode, patches extraction and measurement)
+/// from a worker thread : move it to a QThread and start run(), each stage result is delivered by a signal as soon as it is ready.
+/// The ColorSwatch and its ImagePlugin must not be used by another thread until finished() is emitted.
+class ColorSwatchLoader : public QObject
+{
+	Q_OBJECT
+public:
+	ColorSwatchLoader(std::shared_ptr<ColorSwatch> colorSwatch, ImagePlugin* imgPlg, QString iniFile, QSize previewSize, QObject *parent = 0);
+	virtual ~ColorSwatchLoader();
+
+public slots:
+	void run();
+
+signals:
+	void previewReady	(const QImage &preview);							///< low resolution raw image (headers loaded, not decoded yet)
+	void imageReady		(const QImage &image);								///< decoded raw image (with the mask applied if requested)
+	void patchesReady	(const QVector<QRect> &patches, const QSize &imageSize);	///< patches bounding boxes in the raw image pixel coord system
+	void graphReady		(ColorSwatch::GraphData2D graphRef,
+						 ColorSwatch::GraphData2D graphR,
+						 ColorSwatch::GraphData2D graphG,
+						 ColorSwatch::GraphData2D graphB,
+						 ColorSwatch::GraphData2D graphA );
+	void finished		(bool isLoaded, const QString &error);				///< always emitted last (error is empty when nothing was thrown)
+
+private:
+	class Private;
+	Private *d;
+};
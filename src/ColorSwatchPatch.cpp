@@ -18,6 +18,7 @@ public:
 	std::unique_ptr<MunsellColor>	mMunsellColor;
 	std::unique_ptr<QImage>			mImg;
 	QColor							mAverageRGB;
+	ImagePlugin::pixelSpans			mSpans;
 	int								mRelPixXbegin, mRelPixYbegin; ///< pixel coord origin of this patch (upper left) but in the mask/raw image pixel coord system
 };
 
@@ -63,11 +64,34 @@ void ColorSwatchPatch::setImage(const QImage* img, const int orgPixXrelFromMask,
 	d->mImg.reset(new QImage(*img));
 	d->mRelPixXbegin = orgPixXrelFromMask;
 	d->mRelPixYbegin = orgPixYrelFromMask;
+
+	// default to all pixels of the patch image (one span per row)
+	d->mSpans.clear();
+	d->mSpans.reserve(img->height());
+	for( int row = 0; row < img->height(); row++ )
+		d->mSpans.push_back( ImagePlugin::PixelSpan(d->mRelPixYbegin + row, d->mRelPixXbegin, d->mRelPixXbegin + img->width()) );
+}
+
+void ColorSwatchPatch::setPixelSpans(const ImagePlugin::pixelSpans &spans)
+{
+	d->mSpans = spans;
+}
+
+const ImagePlugin::pixelSpans& ColorSwatchPatch::getPixelSpans() const
+{
+	return d->mSpans;
+}
+
+QRect ColorSwatchPatch::getRect() const
+{
+	if(!d->mImg)
+		return QRect();
+	return QRect(d->mRelPixXbegin, d->mRelPixYbegin, d->mImg->width(), d->mImg->height());
 }
 
 //---------------------------------------------------------------------
 
-bool ColorSwatchPatch::computeAverageRGBpixel(ImagePlugin* imgPlg)
+bool ColorSwatchPatch::computeAverageRGBpixel(const ImagePlugin* imgPlg)
 {
 	if(d->mImg == nullptr && d->mRelPixXbegin == 0 && d->mRelPixYbegin == 0)
 	{
@@ -75,20 +99,10 @@ bool ColorSwatchPatch::computeAverageRGBpixel(ImagePlugin* imgPlg)
 		return false;
 	}
 
-	// compute valid pixels coords of this patch relative from mask image (we assume raw img and mask have the same size)
-	ImagePlugin::pixelsCoords pixCoords;
-	for( int row = 0; row < d->mImg->height(); row++ )
-		for( int col = 0; col < d->mImg->width(); col++ )
-			if( d->mImg->valid(col, row) )
-				pixCoords.push_back(ImagePlugin::makePixelCoord(d->mRelPixXbegin + col, d->mRelPixYbegin + row) );
-
+	// pixels spans of this patch are relative from mask image (we assume raw img and mask have the same size)
 	float r=0.0f, g=0.0f, b=0.0f, a=0.0f;
-	bool result = imgPlg->averagesChannels(pixCoords, r, g, b, a);
-	d->mAverageRGB.setRedF(r);
-	d->mAverageRGB.setGreenF(g);
-	d->mAverageRGB.setBlueF(b);
-	if(0.0f < a < 1.0f)
-		d->mAverageRGB.setAlphaF(a);
+	bool result = imgPlg->averagesChannels(d->mSpans, r, g, b, a);
+	setAverageRGBpixel(r, g, b, a);
 
 	// print average float R G B
 	//std::cout<<"av("<<d->mAverageRGB.redF()<<","<<d->mAverageRGB.greenF()<<","<<d->mAverageRGB.blueF()<<")"<<std::endl;
@@ -96,6 +110,15 @@ bool ColorSwatchPatch::computeAverageRGBpixel(ImagePlugin* imgPlg)
 	return result;
 }
 
+void ColorSwatchPatch::setAverageRGBpixel(float r, float g, float b, float a)
+{
+	d->mAverageRGB.setRedF(r);
+	d->mAverageRGB.setGreenF(g);
+	d->mAverageRGB.setBlueF(b);
+	if(0.0f < a && a < 1.0f)
+		d->mAverageRGB.setAlphaF(a);
+}
+
 //---------------------------------------------------------------------
 
 bool ColorSwatchPatch::haveAverageColor() const
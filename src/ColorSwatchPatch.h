@@ -2,12 +2,14 @@
 
 #include <QString>
 #include <QColor>
+#include <QRect>
+
+#include "ImagePlugin.h"
 
 #include <iostream>
 
 class MunsellColor;
 class QImage;
-class ImagePlugin;
 
 class ColorSwatchPatch
 {
@@ -23,10 +25,17 @@ public:
 	MunsellColor*	getMunsellColor()	const;
 
 	void			setImage(const QImage* img, const int orgPixXrelFromMask, const int orgPixYrelFromMask);
+
+	/// runs of pixels (mask/raw image pixel coord system) used for the average computation (default to the whole patch image)
+	void			setPixelSpans(const ImagePlugin::pixelSpans &spans);
+	const ImagePlugin::pixelSpans& getPixelSpans() const;
+	/// patch bounding rectangle in the mask/raw image pixel coord system (null until setImage)
+	QRect			getRect() const;
 	QString			printPatcheImgInfo() const;
 
 public:
-	bool	computeAverageRGBpixel(ImagePlugin* imgPlg);
+	bool	computeAverageRGBpixel(const ImagePlugin* imgPlg);
+	void	setAverageRGBpixel(float r, float g, float b, float a); ///< average measured elsewhere (e.g. streaming measurement)
 	bool	haveAverageColor()	const;
 	QColor	getAverageColor()	const;
 
@@ -0,0 +1,175 @@
+#include "ColorTransfer.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	const float AdobeRGBGamma		= 563.0f / 256.0f;	// 2.19921875
+	const float GammaCorrectedGamma	= 2.2f;
+
+	// Cineon printing density : reference white 685, reference black 95 (10 bits codes), 0.002 density per code, 0.6 negative gamma
+	const float KodakLogWhite		= 685.0f;
+	const float KodakLogCodesPerDec	= 0.6f / 0.002f;	// 300 codes per decade
+	const float KodakLogBlack		= std::pow(10.0f, (95.0f - KodakLogWhite) / KodakLogCodesPerDec);
+
+	/// odd extension of a power curve defined on [0-1] (keep the sign of negative values)
+	float signedPow(float value, float exponent)
+	{
+		return value < 0.0f ? -std::pow(-value, exponent) : std::pow(value, exponent);
+	}
+}
+
+//---------------------------------------------------------------------
+
+ColorTransfer::Space ColorTransfer::fromName(const std::string &name)
+{
+	if(name == "Linear")			return Space::Linear;
+	if(name == "sRGB")				return Space::sRGB;
+	if(name == "GammaCorrected")	return Space::GammaCorrected;
+	if(name == "AdobeRGB")			return Space::AdobeRGB;
+	if(name == "Rec709")			return Space::Rec709;
+	if(name == "KodakLog")			return Space::KodakLog;
+	return Space::Unknown;
+}
+
+const char* ColorTransfer::name(Space space)
+{
+	switch(space)
+	{
+	case Space::Linear:			return "Linear";
+	case Space::sRGB:			return "sRGB";
+	case Space::GammaCorrected:	return "GammaCorrected";
+	case Space::AdobeRGB:		return "AdobeRGB";
+	case Space::Rec709:			return "Rec709";
+	case Space::KodakLog:		return "KodakLog";
+	default:					return "";
+	}
+}
+
+float ColorTransfer::toLinear(Space space, float encoded)
+{
+	switch(space)
+	{
+	case Space::sRGB:
+		return std::fabs(encoded) <= 0.04045f ? encoded / 12.92f : std::pow((std::fabs(encoded) + 0.055f) / 1.055f, 2.4f) * (encoded < 0.0f ? -1.0f : 1.0f);
+	case Space::Rec709:
+		return std::fabs(encoded) < 0.081f ? encoded / 4.5f : std::pow((std::fabs(encoded) + 0.099f) / 1.099f, 1.0f / 0.45f) * (encoded < 0.0f ? -1.0f : 1.0f);
+	case Space::GammaCorrected:
+		return signedPow(encoded, GammaCorrectedGamma);
+	case Space::AdobeRGB:
+		return signedPow(encoded, AdobeRGBGamma);
+	case Space::KodakLog:
+		return (std::pow(10.0f, (encoded * 1023.0f - KodakLogWhite) / KodakLogCodesPerDec) - KodakLogBlack) / (1.0f - KodakLogBlack);
+	default:
+		return encoded;
+	}
+}
+
+float ColorTransfer::fromLinear(Space space, float linear)
+{
+	switch(space)
+	{
+	case Space::sRGB:
+		return std::fabs(linear) <= 0.0031308f ? linear * 12.92f : (1.055f * std::pow(std::fabs(linear), 1.0f / 2.4f) - 0.055f) * (linear < 0.0f ? -1.0f : 1.0f);
+	case Space::Rec709:
+		return std::fabs(linear) < 0.018f ? linear * 4.5f : (1.099f * std::pow(std::fabs(linear), 0.45f) - 0.099f) * (linear < 0.0f ? -1.0f : 1.0f);
+	case Space::GammaCorrected:
+		return signedPow(linear, 1.0f / GammaCorrectedGamma);
+	case Space::AdobeRGB:
+		return signedPow(linear, 1.0f / AdobeRGBGamma);
+	case Space::KodakLog:
+		{
+			float density = linear * (1.0f - KodakLogBlack) + KodakLogBlack;
+			return density > 0.0f ? (KodakLogWhite + KodakLogCodesPerDec * std::log10(density)) / 1023.0f : 0.0f;
+		}
+	default:
+		return linear;
+	}
+}
+
+//---------------------------------------------------------------------
+
+ColorTransfer::ColorTransfer(Space from, Space to)
+	: mFrom(from == Space::Unknown ? Space::Linear : from)
+	, mTo(to == Space::Unknown ? Space::Linear : to)
+{
+	if(isIdentity())
+		return;
+
+	// sampled on sqrt(value) : finer steps near black where the power curves are steep
+	mTable.resize(Steps + 1);
+	for(int i = 0; i <= Steps; i++)
+	{
+		float u = float(i) / Steps;
+		mTable[i] = exact(u * u);
+	}
+
+	mTable8.resize(256);
+	for(int i = 0; i < 256; i++)
+		mTable8[i] = exact(float(i) / 255.0f);
+
+	mTable16.resize(65536);
+	for(int i = 0; i < 65536; i++)
+		mTable16[i] = exact(float(i) / 65535.0f);
+}
+
+bool ColorTransfer::isIdentity() const
+{
+	return mFrom == mTo;
+}
+
+float ColorTransfer::exact(float value) const
+{
+	return fromLinear(mTo, toLinear(mFrom, value));
+}
+
+float ColorTransfer::operator()(float value) const
+{
+	if(isIdentity())
+		return value;
+	if(!(value >= 0.0f && value <= 1.0f)) // also NaN (kept as is by the exact functions)
+		return exact(value);
+	float	pos		= std::sqrt(value) * Steps;
+	int		i		= std::min(int(pos), Steps - 1);
+	float	t		= pos - float(i);
+	return mTable[i] + t * (mTable[i+1] - mTable[i]);
+}
+
+//---------------------------------------------------------------------
+
+void ColorTransfer::convert(const float *src, float *dst, std::size_t nbPixels, int nbChannels, int nbColorChannels) const
+{
+	for(std::size_t p = 0; p < nbPixels; p++, src += nbChannels, dst += nbChannels)
+	{
+		int c = 0;
+		for(; c < nbColorChannels; c++)
+			dst[c] = (*this)(src[c]);
+		for(; c < nbChannels; c++)
+			dst[c] = src[c];
+	}
+}
+
+void ColorTransfer::convert(const std::uint8_t *src, float *dst, std::size_t nbPixels, int nbChannels, int nbColorChannels) const
+{
+	for(std::size_t p = 0; p < nbPixels; p++, src += nbChannels, dst += nbChannels)
+	{
+		int c = 0;
+		for(; c < nbColorChannels; c++)
+			dst[c] = isIdentity() ? src[c] / 255.0f : mTable8[src[c]];
+		for(; c < nbChannels; c++)
+			dst[c] = src[c] / 255.0f;
+	}
+}
+
+void ColorTransfer::convert(const std::uint16_t *src, float *dst, std::size_t nbPixels, int nbChannels, int nbColorChannels) const
+{
+	for(std::size_t p = 0; p < nbPixels; p++, src += nbChannels, dst += nbChannels)
+	{
+		int c = 0;
+		for(; c < nbColorChannels; c++)
+			dst[c] = isIdentity() ? src[c] / 65535.0f : mTable16[src[c]];
+		for(; c < nbChannels; c++)
+			dst[c] = src[c] / 65535.0f;
+	}
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/// Transfer functions (linear <-> encoded) of the colorspaces handled by the image plugins
+/// and their conversion from one colorspace to another through precomputed tables.
+/// Only the color channels are converted (transfer curves only : the primaries are not changed).
+class ColorTransfer
+{
+public:
+	enum class Space {Unknown, Linear, sRGB, GammaCorrected, AdobeRGB, Rec709, KodakLog};
+
+	/// OIIO names ("Linear", "sRGB", "GammaCorrected", "AdobeRGB", "Rec709", "KodakLog"), Unknown otherwise
+	static Space		fromName(const std::string &name);
+	static const char*	name(Space space);
+
+	/// exact transfer functions (values outside [0-1] are extended)
+	static float toLinear	(Space space, float encoded);
+	static float fromLinear	(Space space, float linear);
+
+public:
+	/// conversion tables from one colorspace to another (Unknown is used as Linear)
+	ColorTransfer(Space from, Space to);
+
+	bool isIdentity() const;
+
+	/// converted value : table interpolation in [0-1] (error < 3e-4, up to 1.5e-3 around the KodakLog black), exact functions outside
+	float operator()(float value) const;
+
+	/// convert nbPixels interleaved pixels of nbChannels : only the first nbColorChannels are converted, the others are copied
+	/// (integer values are normalized to [0-1]). In place is allowed for float (src == dst).
+	void convert(const float			*src, float *dst, std::size_t nbPixels, int nbChannels, int nbColorChannels) const;
+	void convert(const std::uint8_t		*src, float *dst, std::size_t nbPixels, int nbChannels, int nbColorChannels) const;
+	void convert(const std::uint16_t	*src, float *dst, std::size_t nbPixels, int nbChannels, int nbColorChannels) const;
+
+private:
+	float exact(float value) const;
+
+private:
+	static const int	Steps = 16384;	///< [0-1] table steps (linear interpolation between them)
+	Space				mFrom, mTo;
+	std::vector<float>	mTable;			///< Steps+1 values of [0-1] (sampled on the square root of the value)
+	std::vector<float>	mTable8;		///< every uint8 code
+	std::vector<float>	mTable16;		///< every uint16 code
+};
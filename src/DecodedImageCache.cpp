@@ -0,0 +1,145 @@
+#include "DecodedImageCache.h"
+
+#include <QDateTime>
+#include <QFileInfo>
+
+#include <iostream>
+#include <list>
+#include <mutex>
+
+class DecodedImageCache::Private
+{
+public:
+	struct Entry
+	{
+		Key							mKey;
+		std::shared_ptr<const void>	mBuffer;
+		std::size_t					mBytes;
+	};
+
+	Private() : mMaxBytes(std::size_t(1024) * 1024 * 1024), mBytes(0)
+	{}
+
+	/// evict the least recently used entries (list back) until the budget is respected
+	void evict()
+	{
+		while(mBytes > mMaxBytes && !mEntries.empty())
+		{
+			mBytes -= mEntries.back().mBytes;
+			std::cout<<"Decoded image cache: evict "<<mEntries.back().mKey.filePath.toStdString()<<" ["<<mEntries.back().mKey.pluginId.toStdString()<<"]"<<std::endl;
+			mEntries.pop_back();
+		}
+	}
+
+	std::list<Entry>::iterator lookup(const Key &key)
+	{
+		std::list<Entry>::iterator it = mEntries.begin();
+		while(it != mEntries.end() && !(it->mKey == key))
+			++it;
+		return it;
+	}
+
+public:
+	mutable std::mutex	mMutex;
+	std::list<Entry>	mEntries;	///< most recently used first (only a few images : linear lookup)
+	std::size_t			mMaxBytes;
+	std::size_t			mBytes;
+};
+
+//---------------------------------------------------------------------
+
+bool DecodedImageCache::Key::operator==(const Key &other) const
+{
+	return	filePath		== other.filePath		&&
+			lastModified	== other.lastModified	&&
+			fileSize		== other.fileSize		&&
+			pluginId		== other.pluginId		&&
+			colorSpace		== other.colorSpace;
+}
+
+DecodedImageCache::Key DecodedImageCache::makeKey(const QString &filePath, const QString &pluginId, const QString &colorSpace)
+{
+	QFileInfo info(filePath);
+	Key key;
+	key.filePath		= info.absoluteFilePath();
+	key.lastModified	= info.lastModified().toMSecsSinceEpoch();
+	key.fileSize		= info.size();
+	key.pluginId		= pluginId;
+	key.colorSpace		= colorSpace;
+	return key;
+}
+
+DecodedImageCache& DecodedImageCache::instance()
+{
+	static DecodedImageCache cache;
+	return cache;
+}
+
+//---------------------------------------------------------------------
+
+DecodedImageCache::DecodedImageCache() : d(new Private)
+{
+}
+
+DecodedImageCache::~DecodedImageCache()
+{
+	delete d;
+}
+
+//---------------------------------------------------------------------
+
+void DecodedImageCache::setMaxBytes(std::size_t maxBytes)
+{
+	std::lock_guard<std::mutex> lock(d->mMutex);
+	d->mMaxBytes = maxBytes;
+	d->evict();
+}
+
+std::size_t DecodedImageCache::maxBytes() const
+{
+	std::lock_guard<std::mutex> lock(d->mMutex);
+	return d->mMaxBytes;
+}
+
+std::size_t DecodedImageCache::bytes() const
+{
+	std::lock_guard<std::mutex> lock(d->mMutex);
+	return d->mBytes;
+}
+
+void DecodedImageCache::clear()
+{
+	std::lock_guard<std::mutex> lock(d->mMutex);
+	d->mEntries.clear();
+	d->mBytes = 0;
+}
+
+//---------------------------------------------------------------------
+
+std::shared_ptr<const void> DecodedImageCache::findBuffer(const Key &key)
+{
+	std::lock_guard<std::mutex> lock(d->mMutex);
+	std::list<Private::Entry>::iterator it = d->lookup(key);
+	if(it == d->mEntries.end())
+		return nullptr;
+	d->mEntries.splice(d->mEntries.begin(), d->mEntries, it);
+	return d->mEntries.front().mBuffer;
+}
+
+void DecodedImageCache::insertBuffer(const Key &key, const std::shared_ptr<const void> &buffer, std::size_t bytes)
+{
+	std::lock_guard<std::mutex> lock(d->mMutex);
+	std::list<Private::Entry>::iterator it = d->lookup(key);
+	if(it != d->mEntries.end())
+	{
+		d->mBytes -= it->mBytes;
+		d->mEntries.erase(it);
+	}
+	if(!buffer || bytes > d->mMaxBytes)
+		return;
+
+	Private::Entry entry = {key, buffer, bytes};
+	d->mEntries.push_front(entry);
+	d->mBytes += bytes;
+	d->evict();
+}
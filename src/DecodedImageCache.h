@@ -0,0 +1,62 @@
+#pragma once
+
+#include <QString>
+
+#include <cstddef>
+#include <memory>
+
+/// Process-wide cache of the decoded image buffers, shared by all the ImagePlugin instances (reloads and plugin switches).
+/// Each plugin stores its own buffer type (immutable once inserted), the plugin id in the key keeps the types apart.
+/// Least recently used entries are evicted to keep the cached bytes under the budget (buffers still used by a plugin stay alive until released).
+/// All methods are thread-safe.
+class DecodedImageCache
+{
+public:
+	struct Key
+	{
+		QString		filePath;		///< absolute file path
+		qint64		lastModified;	///< ms since epoch : a modified file never hit an old entry
+		qint64		fileSize;
+		QString		pluginId;
+		QString		colorSpace;
+
+		bool operator==(const Key &other) const;
+	};
+
+	/// Key of the current version of filePath (file info read now)
+	static Key makeKey(const QString &filePath, const QString &pluginId, const QString &colorSpace);
+
+	static DecodedImageCache& instance();
+
+public:
+	/// bytes budget (default 1 GiB), 0 disable the cache
+	void		setMaxBytes(std::size_t maxBytes);
+	std::size_t	maxBytes()	const;
+	std::size_t	bytes()		const;
+	void		clear();
+
+	/// nullptr when not cached, otherwise the entry become the most recently used
+	template<typename T> std::shared_ptr<const T> find(const Key &key)
+	{
+		return std::static_pointer_cast<const T>(findBuffer(key));
+	}
+
+	/// replace any entry of the same key (not inserted when larger than the whole budget)
+	template<typename T> void insert(const Key &key, const std::shared_ptr<const T> &buffer, std::size_t bytes)
+	{
+		insertBuffer(key, std::static_pointer_cast<const void>(buffer), bytes);
+	}
+
+private:
+	DecodedImageCache();
+	~DecodedImageCache();
+	DecodedImageCache(const DecodedImageCache&) = delete;
+	DecodedImageCache& operator=(const DecodedImageCache&) = delete;
+
+	std::shared_ptr<const void>	findBuffer	(const Key &key);
+	void						insertBuffer(const Key &key, const std::shared_ptr<const void> &buffer, std::size_t bytes);
+
+private:
+	class Private;
+	Private *d;
+};
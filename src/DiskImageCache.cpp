@@ -0,0 +1,173 @@
+#include "DiskImageCache.h"
+#include "PreBuildUtil.h"
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFileInfo>
+#include <QRegExp>
+
+#include <iostream>
+#include <mutex>
+
+class DiskImageCache::Private
+{
+public:
+	mutable std::mutex	mMutex;
+	QString				mDirectory;
+};
+
+namespace
+{
+	const quint64 DataAlignment = 64;
+
+	/// SHA-1 of the whole file content (hex), empty if it cannot be read
+	QString contentHash(const QString &filePath)
+	{
+		QFile file(filePath);
+		if(!file.open(QIODevice::ReadOnly))
+			return QString();
+		QCryptographicHash hash(QCryptographicHash::Sha1);
+		if(!hash.addData(&file))
+			return QString();
+		return QString(hash.result().toHex());
+	}
+}
+
+//---------------------------------------------------------------------
+
+DiskImageCache::Mapping::Mapping(const QString &entryPath)
+	: mFile(entryPath)
+	, mData(nullptr)
+{
+	if(!mFile.open(QIODevice::ReadOnly) || quint64(mFile.size()) < sizeof(Header))
+		return;
+	mData = mFile.map(0, mFile.size());
+}
+
+DiskImageCache::Mapping::~Mapping()
+{
+	if(mData)
+		mFile.unmap(mData);
+}
+
+const DiskImageCache::Header& DiskImageCache::Mapping::header() const
+{
+	return *reinterpret_cast<const Header*>(mData);
+}
+
+const uchar* DiskImageCache::Mapping::pixels() const
+{
+	return mData + header().dataOffset;
+}
+
+//---------------------------------------------------------------------
+
+DiskImageCache& DiskImageCache::instance()
+{
+	static DiskImageCache cache;
+	return cache;
+}
+
+DiskImageCache::DiskImageCache() : d(new Private)
+{
+}
+
+DiskImageCache::~DiskImageCache()
+{
+	delete d;
+}
+
+//---------------------------------------------------------------------
+
+void DiskImageCache::setDirectory(const QString &directory)
+{
+	if(!directory.isEmpty() && !QDir().mkpath(directory))
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] cannot create "<<directory.toStdString()<<" : disk image cache disabled."<<std::endl;
+		return;
+	}
+	std::lock_guard<std::mutex> lock(d->mMutex);
+	d->mDirectory = directory;
+}
+
+QString DiskImageCache::directory() const
+{
+	std::lock_guard<std::mutex> lock(d->mMutex);
+	return d->mDirectory;
+}
+
+bool DiskImageCache::isEnabled() const
+{
+	return !directory().isEmpty();
+}
+
+//---------------------------------------------------------------------
+
+QString DiskImageCache::entryPath(const QString &filePath, const QString &pluginId, const QString &settings) const
+{
+	QString dir = directory();
+	if(dir.isEmpty())
+		return QString();
+	QString hash = contentHash(filePath);
+	if(hash.isEmpty())
+		return QString();
+	QString name = QString("%1_%2_%3.cilc").arg(hash).arg(pluginId).arg(settings);
+	name.replace(QRegExp("[^A-Za-z0-9_.-]"), "-");
+	return QDir(dir).absoluteFilePath(name);
+}
+
+std::shared_ptr<const DiskImageCache::Mapping> DiskImageCache::map(const QString &entryPath) const
+{
+	if(entryPath.isEmpty() || !QFileInfo(entryPath).isFile())
+		return nullptr;
+
+	std::shared_ptr<Mapping> mapping(new Mapping(entryPath));
+	if(!mapping->mData)
+		return nullptr;
+
+	const Header &header	= mapping->header();
+	quint64 fileSize		= quint64(mapping->mFile.size());
+	if(header.magic != Magic || header.version != Version
+		|| header.dataOffset < sizeof(Header) || header.dataBytes != header.bytesPerLine * quint64(header.height)
+		|| header.dataOffset + header.dataBytes > fileSize)
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] invalid disk image cache entry "<<entryPath.toStdString()<<std::endl;
+		return nullptr;
+	}
+	return mapping;
+}
+
+bool DiskImageCache::store(const QString &entryPath, Header header, const uchar *pixels) const
+{
+	if(entryPath.isEmpty() || pixels == nullptr)
+		return false;
+
+	header.magic		= Magic;
+	header.version		= Version;
+	header.dataOffset	= (sizeof(Header) + DataAlignment - 1) / DataAlignment * DataAlignment;
+	header.dataBytes	= header.bytesPerLine * quint64(header.height);
+
+	// written aside then renamed : a concurrent run never map a partial entry
+	QString tmpPath = entryPath + ".tmp";
+	QFile file(tmpPath);
+	if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] cannot write "<<tmpPath.toStdString()<<std::endl;
+		return false;
+	}
+	QByteArray padding(int(header.dataOffset - sizeof(Header)), '\0');
+	bool ok = file.write(reinterpret_cast<const char*>(&header), sizeof(Header)) == qint64(sizeof(Header))
+		&& file.write(padding) == padding.size()
+		&& file.write(reinterpret_cast<const char*>(pixels), qint64(header.dataBytes)) == qint64(header.dataBytes);
+	file.close();
+
+	QFile::remove(entryPath);
+	if(!ok || !QFile::rename(tmpPath, entryPath))
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] cannot write "<<entryPath.toStdString()<<std::endl;
+		QFile::remove(tmpPath);
+		return false;
+	}
+	std::cout<<"Disk image cache: stored "<<entryPath.toStdString()<<std::endl;
+	return true;
+}
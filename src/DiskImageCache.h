@@ -0,0 +1,73 @@
+#pragma once
+
+#include <QFile>
+#include <QString>
+
+#include <cstddef>
+#include <memory>
+
+/// Optional on-disk cache of the decoded image buffers, to skip the decode across the runs (e.g. same raw shots measured on each build).
+/// An entry is one file : a fixed Header followed by the raw pixels rows, memory mapped when read back
+/// so a plugin can serve its reads straight from the mapping (no decode, no copy).
+/// Entries are named from the source file content hash, the plugin id and the decode settings. Disabled until a directory is set.
+/// All methods are thread-safe.
+class DiskImageCache
+{
+public:
+	struct Header
+	{
+		quint32	magic;
+		quint32	version;
+		qint32	width;
+		qint32	height;
+		qint32	nbChannels;
+		qint32	format;			///< plugin specific pixels format (e.g. OIIO TypeDesc::BASETYPE, QImage::Format)
+		quint64	bytesPerLine;
+		quint64	dataOffset;		///< from the file begin, 64 bytes aligned
+		quint64	dataBytes;		///< bytesPerLine * height
+	};
+	static const quint32 Magic		= 0x434c4943; ///< "CILC"
+	static const quint32 Version	= 1;
+
+	/// read-only mapping of one entry, unmapped when released
+	class Mapping
+	{
+	public:
+		~Mapping();
+		const Header&	header() const;
+		const uchar*	pixels() const;
+
+	private:
+		friend class DiskImageCache;
+		Mapping(const QString &entryPath);
+		QFile	mFile;
+		uchar*	mData;
+	};
+
+	static DiskImageCache& instance();
+
+public:
+	/// directory of the entries (created if needed), empty disable the cache (default)
+	void	setDirectory(const QString &directory);
+	QString	directory()	const;
+	bool	isEnabled()	const;
+
+	/// entry file path of filePath decoded by pluginId with settings (empty when disabled or filePath cannot be read)
+	QString	entryPath(const QString &filePath, const QString &pluginId, const QString &settings) const;
+
+	/// nullptr when the entry does not exist or is not valid
+	std::shared_ptr<const Mapping> map(const QString &entryPath) const;
+
+	/// write header (offset and size set here) followed by the pixels rows (contiguous), return false on error
+	bool	store(const QString &entryPath, Header header, const uchar *pixels) const;
+
+private:
+	DiskImageCache();
+	~DiskImageCache();
+	DiskImageCache(const DiskImageCache&) = delete;
+	DiskImageCache& operator=(const DiskImageCache&) = delete;
+
+private:
+	class Private;
+	Private *d;
+};
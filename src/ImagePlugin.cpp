@@ -1,5 +1,10 @@
 #include "ImagePlugin.h"
 #include "PreBuildUtil.h"
+#include "ChannelKernels.h"
+#include "ParallelFor.h"
+#include "DecodedImageCache.h"
+#include "DiskImageCache.h"
+#include "ColorTransfer.h"
 
 #include <QImage>
 #include <QColor>
@@ -9,6 +14,168 @@
 
 #include <memory>
 #include <iostream>
+#include <algorithm>
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+//---------------------------------------------------------------------
+//---------   ImagePlugin  ----------------------------------------
+//---------------------------------------------------------------------
+
+const char* ImagePlugin::loadStateName(LoadState state)
+{
+	switch(state)
+	{
+	case LoadState::Unopened:	return "Unopened";
+	case LoadState::HeaderOnly:	return "HeaderOnly";
+	case LoadState::Decoded:	return "Decoded";
+	case LoadState::Converted:	return "Converted";
+	}
+	return "";
+}
+
+std::vector< std::pair<QString, ImagePlugin::Factory> > ImagePlugin::registeredPlugins()
+{
+	std::vector< std::pair<QString, Factory> > plugins;
+	plugins.push_back( std::make_pair(QString("Qt"),			Factory([]() -> ImagePlugin* {return new ImagePluginQt;})) );
+	plugins.push_back( std::make_pair(QString("OpenImageIO"),	Factory([]() -> ImagePlugin* {return new ImagePluginOIIO;})) );
+	plugins.push_back( std::make_pair(QString("OpenEXR"),		Factory([]() -> ImagePlugin* {return new ImagePluginOpenEXR;})) );
+#ifdef USE_LIBRAW
+	plugins.push_back( std::make_pair(QString("LibRaw"),		Factory([]() -> ImagePlugin* {return new ImagePluginLibRaw;})) );
+#endif
+#ifdef USE_GRAPHICSMAGICK
+	plugins.push_back( std::make_pair(QString("GraphicsMagick"),	Factory([]() -> ImagePlugin* {return new ImagePluginGraphicsMagick;})) );
+#endif
+	return plugins;
+}
+
+//---------------------------------------------------------------------
+
+std::ostream& operator<<(std::ostream &stream, const ImagePlugin::ImageInfo &info)
+{
+	stream<<info.width<<"x"<<info.height<<" "<<info.nbChannels<<" channels "<<info.bitDepth<<" bits";
+	if(!info.colorSpace.isEmpty())
+		stream<<" "<<info.colorSpace.toStdString();
+	if(info.exposureTime > 0.0f)
+		stream<<" exposure "<<info.exposureTime<<"s";
+	if(info.fNumber > 0.0f)
+		stream<<" f/"<<info.fNumber;
+	if(info.isoSpeed > 0)
+		stream<<" ISO "<<info.isoSpeed;
+	return stream;
+}
+
+//---------------------------------------------------------------------
+
+ImagePlugin::pixelSpans ImagePlugin::makePixelSpans(const pixelsCoords &pixCoords)
+{
+	pixelSpans spans;
+	std::size_t i = 0;
+	while(i < pixCoords.size())
+	{
+		int x = pixCoords[i].first;
+		int y = pixCoords[i].second;
+		std::size_t j = i + 1;
+		while(j < pixCoords.size() && pixCoords[j].second == y && pixCoords[j].first == x + int(j - i))
+			j++;
+		spans.push_back( PixelSpan(y, x, x + int(j - i)) );
+		i = j;
+	}
+	return spans;
+}
+
+//---------------------------------------------------------------------
+
+bool ImagePlugin::averagesChannelsFromView(const PixelView &view, const pixelSpans &spans, float &r, float &g, float &b, float &a)
+{
+	if(!view.isValid() || view.nbChannels > 4 || spans.empty())
+		return false;
+
+	// the kernels need packed interleaved pixels of a supported type
+	int channelSize = 0;
+	switch(view.type)
+	{
+	case PixelType::UINT8	: channelSize = 1; break;
+	case PixelType::UINT16	: channelSize = 2; break;
+	case PixelType::HALF	: channelSize = 2; break;
+	case PixelType::FLOAT	: channelSize = 4; break;
+	default : return false;
+	}
+	if(view.pixelStride != view.nbChannels*channelSize)
+		return false;
+
+	std::uint64_t	intSums[4]	= {0, 0, 0, 0};	// exact accumulation for integer formats
+	double			realSums[4]	= {0, 0, 0, 0};
+	std::size_t		nbPixels	= 0;
+	for(const PixelSpan &span : spans)
+	{
+		if(span.width() <= 0)
+			continue;
+		if(!view.rect.contains(span.xBegin, span.row) || !view.rect.contains(span.xEnd - 1, span.row))
+			return false;
+
+		const unsigned char *run	= view.pixel(span.xBegin, span.row);
+		std::size_t			count	= std::size_t(span.width());
+		switch(view.type)
+		{
+		case PixelType::UINT8	: ChannelKernels::sumUInt8	(run, count, view.nbChannels, intSums);										break;
+		case PixelType::UINT16	: ChannelKernels::sumUInt16	(reinterpret_cast<const std::uint16_t*>(run), count, view.nbChannels, intSums);	break;
+		case PixelType::HALF	: ChannelKernels::sumHalf	(reinterpret_cast<const std::uint16_t*>(run), count, view.nbChannels, realSums);	break;
+		case PixelType::FLOAT	: ChannelKernels::sumFloat	(reinterpret_cast<const float*>(run), count, view.nbChannels, realSums);		break;
+		default : break;
+		}
+		nbPixels += count;
+	}
+	if(nbPixels == 0)
+		return false;
+
+	// integer formats are normalized to float [0-1] only for the final means
+	double scale = view.type == PixelType::UINT8 ? 1.0/255.0 : view.type == PixelType::UINT16 ? 1.0/65535.0 : 1.0;
+	float averages[4] = {0.0f, 0.0f, 0.0f, 1.0f};
+	for(int c = 0; c < 4; c++)
+	{
+		int stored = view.channelIndex[c];
+		if(stored >= 0)
+			averages[c] = float( (view.type == PixelType::FLOAT || view.type == PixelType::HALF ? realSums[stored] : double(intSums[stored])) * scale / double(nbPixels) );
+	}
+	r = averages[0];
+	g = averages[1];
+	b = averages[2];
+	a = averages[3];
+	return true;
+}
+
+//---------------------------------------------------------------------
+
+bool ImagePlugin::streamAveragesChannels(const std::vector<pixelSpans> &spansLists, std::vector<float> &averages)
+{
+	// no band reader for this plugin : measure the decoded image
+	if(!decode())
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] cannot decode image...abort."<<std::endl;
+		return false;
+	}
+	averages.assign(spansLists.size() * 4, 0.0f);
+	bool result = true;
+	for(std::size_t i = 0; i < spansLists.size(); i++)
+		result = averagesChannels(spansLists[i], averages[4*i], averages[4*i+1], averages[4*i+2], averages[4*i+3]) && result;
+	return result;
+}
+
+namespace
+{
+	/// memory size of a QImage (byteCount() is deprecated since Qt 5.10)
+	std::size_t qimageBytes(const QImage &img)
+	{
+#if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
+		return std::size_t(img.sizeInBytes());
+#else
+		return std::size_t(img.byteCount());
+#endif
+	}
+}
 
 //---------------------------------------------------------------------
 //---------   ImagePluginQt  ----------------------------------------
@@ -17,10 +184,45 @@
 class ImagePluginQt::Private
 {
 public:
-	Private() : mQimg(std::make_shared<QImage>())
+	Private() : mQimg(std::make_shared<QImage>()), mState(LoadState::Unopened)
 	{}
+
+	/// fixed pixels layout of the decoded image, read by pointer arithmetic : RGBA64 for the 16 bits formats (Qt >= 5.12), RGBA8888 otherwise
+	static QImage::Format normalizedFormat(QImage::Format format)
+	{
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+		switch(format)
+		{
+		case QImage::Format_RGBX64 :
+		case QImage::Format_RGBA64 :
+		case QImage::Format_RGBA64_Premultiplied :
+#if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
+		case QImage::Format_Grayscale16 :
+#endif
+			return QImage::Format_RGBA64;
+		default : break;
+		}
+#endif
+		return QImage::Format_RGBA8888;
+	}
+
+	/// converted once (shallow copy when already normalized, e.g. a disk cache mapping)
+	static QImage normalized(const QImage &img)
+	{
+		QImage::Format format = normalizedFormat(img.format());
+		return img.format() == format ? img : img.convertToFormat(format);
+	}
+
+	/// channel c [0-1] of a pixel of the normalized image
+	static float channel(const PixelView &view, const unsigned char *pix, int c)
+	{
+		return view.type == PixelType::UINT16 ? reinterpret_cast<const quint16*>(pix)[c]/65535.0f : pix[c]/255.0f;
+	}
+
 public:
+	QString					mFileName;
 	std::shared_ptr<QImage> mQimg;
+	LoadState				mState;
 };
 
 //---------------------------------------------------------------------
@@ -51,117 +253,271 @@ QString ImagePluginQt::getImageFilterExtensions()
 
 //---------------------------------------------------------------------
 
+ImagePlugin::ImageInfo ImagePluginQt::probe(QString filename) const
+{
+	ImageInfo info;
+	QImageReader reader(filename);
+	if(!reader.canRead())
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] cannot read "<<filename.toStdString()<<": "<<reader.errorString().toStdString()<<std::endl;
+		return info;
+	}
+	info.width	= reader.size().width();
+	info.height	= reader.size().height();
+
+	// QImage only decode 8 bits per channel formats (except RGBA64), EXIF are not exposed by Qt
+	QImage::Format format = reader.imageFormat();
+	switch(format)
+	{
+	case QImage::Format_Mono:
+	case QImage::Format_MonoLSB:
+#if QT_VERSION >= QT_VERSION_CHECK(5, 5, 0)
+	case QImage::Format_Grayscale8:
+#endif
+		info.nbChannels = 1;
+		break;
+	case QImage::Format_Invalid:
+		break;
+	default:
+		info.nbChannels = QImage(1, 1, format).hasAlphaChannel() ? 4 : 3;
+		break;
+	}
+	info.bitDepth = (format == QImage::Format_Mono || format == QImage::Format_MonoLSB) ? 1 : 8;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+	if(format == QImage::Format_RGBX64 || format == QImage::Format_RGBA64 || format == QImage::Format_RGBA64_Premultiplied)
+		info.bitDepth = 16;
+#endif
+	return info;
+}
+
+//---------------------------------------------------------------------
+
 bool ImagePluginQt::loadImage(QString filename)
 {
 	d->mQimg.reset(new QImage);
-	return d->mQimg->load(filename);
+	d->mFileName = filename;
+	d->mState = LoadState::Unopened;
+	QImageReader reader(filename);
+	if(!reader.canRead())
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] cannot read "<<filename.toStdString()<<": "<<reader.errorString().toStdString()<<std::endl;
+		return false;
+	}
+	d->mState = LoadState::HeaderOnly;
+	return true;
+}
+
+//---------------------------------------------------------------------
+
+bool ImagePluginQt::decode()
+{
+	if(isDecoded())
+		return true;
+	if(d->mState != LoadState::HeaderOnly)
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] image not loaded...abort."<<std::endl;
+		return false;
+	}
+	// QImageReader doesn't report its progress : the decode can only be cancelled before it starts
+	if(progress(0.0f))
+		return false;
+
+	// a shallow copy of the cached image (detached if written, e.g. by the mask application)
+	DecodedImageCache::Key key = DecodedImageCache::makeKey(d->mFileName, "Qt", mColorSpace);
+	if(std::shared_ptr<const QImage> cached = DecodedImageCache::instance().find<QImage>(key))
+	{
+		d->mQimg	= std::make_shared<QImage>(*cached);
+		d->mState	= LoadState::Decoded;
+		progress(1.0f);
+		return true;
+	}
+
+	// the disk cache entry is wrapped (read-only, detached if written) : the mapping is released with the last QImage sharing it
+	QString diskEntry = DiskImageCache::instance().entryPath(d->mFileName, "Qt", mColorSpace);
+	if(std::shared_ptr<const DiskImageCache::Mapping> mapping = DiskImageCache::instance().map(diskEntry))
+	{
+		const DiskImageCache::Header &header = mapping->header();
+		QImage::Format format = QImage::Format(header.format);
+		if(header.width > 0 && header.height > 0 && format > QImage::Format_Indexed8 && format < QImage::NImageFormats
+			&& header.bytesPerLine >= (quint64(header.width) * QImage::toPixelFormat(format).bitsPerPixel() + 7) / 8) // rows never read past the mapping
+		{
+			std::shared_ptr<const DiskImageCache::Mapping> *keepAlive = new std::shared_ptr<const DiskImageCache::Mapping>(mapping);
+			QImage wrapped(mapping->pixels(), header.width, header.height, int(header.bytesPerLine), format,
+				[](void *info){ delete static_cast<std::shared_ptr<const DiskImageCache::Mapping>*>(info); }, keepAlive);
+			wrapped = Private::normalized(wrapped); // entries of older runs may hold an other format
+			DecodedImageCache::instance().insert(key, std::shared_ptr<const QImage>(new QImage(wrapped)), qimageBytes(wrapped));
+			d->mQimg	= std::make_shared<QImage>(wrapped);
+			d->mState	= LoadState::Decoded;
+			progress(1.0f);
+			return true;
+		}
+	}
+
+	QImage loaded;
+	if(!loaded.load(d->mFileName))
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] cannot decode "<<d->mFileName.toStdString()<<std::endl;
+		return false;
+	}
+	std::shared_ptr<QImage> img(new QImage(Private::normalized(loaded)));
+	loaded = QImage();
+	DecodedImageCache::instance().insert(key, std::shared_ptr<const QImage>(new QImage(*img)), qimageBytes(*img));
+	if(!diskEntry.isEmpty())
+	{
+		DiskImageCache::Header header;
+		header.width		= img->width();
+		header.height		= img->height();
+		header.nbChannels	= 4;
+		header.format		= int(img->format());
+		header.bytesPerLine	= quint64(img->bytesPerLine());
+		DiskImageCache::instance().store(diskEntry, header, img->constBits());
+	}
+	d->mQimg	= img;
+	d->mState	= LoadState::Decoded;
+	progress(1.0f);
+	return true;
+}
+
+QRect ImagePluginQt::decodedRegion() const
+{
+	return isDecoded() ? d->mQimg->rect() : QRect();
+}
+
+ImagePlugin::LoadState ImagePluginQt::loadState() const
+{
+	return d->mState;
+}
+
+ImagePlugin::PixelType ImagePluginQt::decodedType() const
+{
+	return pixelView().type;
 }
 
 //---------------------------------------------------------------------
 
 QImage ImagePluginQt::toQImage()
 {
-	return d->mQimg ? *d->mQimg.get() : QImage();
+	return decode() ? *d->mQimg.get() : QImage();
+}
+
+//---------------------------------------------------------------------
+
+QImage ImagePluginQt::preview(const QSize &maxSize) const
+{
+	// only the file name is used : it can run while an other thread decode the image
+	if(d->mFileName.isEmpty())
+		return QImage();
+
+	// some readers decode directly at the scaled size (JPEG DCT scaling), others scale after decoding
+	QImageReader reader(d->mFileName);
+	QSize size = reader.size();
+	if(size.isValid() && (size.width() > maxSize.width() || size.height() > maxSize.height()))
+		reader.setScaledSize(size.scaled(maxSize, Qt::KeepAspectRatio));
+	return reader.read();
 }
 
 //---------------------------------------------------------------------
 
-QSize ImagePluginQt::size()
+QSize ImagePluginQt::size() const
 {
-	return d->mQimg ? d->mQimg->size() : QSize();
+	if(isDecoded())
+		return d->mQimg->size();
+	// header only
+	return d->mState == LoadState::HeaderOnly ? QImageReader(d->mFileName).size() : QSize();
 }
 
 //---------------------------------------------------------------------
 
-float ImagePluginQt::readSinglePixelChannel(int x, int y, int channel)
+float ImagePluginQt::readSinglePixelChannel(int x, int y, int channel) const
 {
-	if(!d->mQimg)
+	if(!isDecoded())
 	{
-		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"]Cannot continue without a valid QImage loaded."<<std::endl;
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"]Cannot continue without a valid QImage decoded."<<std::endl;
 		return false;
 	}
-	if(d->mQimg->valid(x, y))
-	{
-		QRgb pix = d->mQimg->pixel(x,y);
-		switch(channel)
-		{
-		case 0:		return qRed(pix)/255.0f;	break;
-		case 1:		return qGreen(pix)/255.0f;	break;
-		case 2:		return qBlue(pix)/255.0f;	break;
-		case 3:		return qAlpha(pix)/255.0f;	break;
-		default:	return 0.0f;
-		}
-	}
-	return 0.0f;
+	PixelView view = pixelView();
+	if(!view.rect.contains(x, y) || channel < 0 || channel > 3)
+		return 0.0f;
+	return Private::channel(view, d->mQimg->constScanLine(y) + x*view.pixelStride, channel);
 }
 
 //---------------------------------------------------------------------
 
-bool ImagePluginQt::averagesChannels(pixelsCoords pixCoords, float &r, float &g, float &b, float &a)
+bool ImagePluginQt::readRegion(const QRect &region, float *pixels, int nbChannels) const
 {
-	if(!d->mQimg)
+	if(!isDecoded())
 	{
-		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"]Cannot continue without a valid QImage loaded."<<std::endl;
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"]Cannot continue without a valid QImage decoded."<<std::endl;
+		return false;
+	}
+	if(!d->mQimg->rect().contains(region) || pixels == nullptr || nbChannels < 1)
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] region is outside the image or output buffer is invalid...abort."<<std::endl;
 		return false;
 	}
 
-	bool err = false;
-	int nbPixels = 0;
+	// the normalized layout is RGBA (8 or 16 bits) : walk each scanline
+	PixelView view = pixelView();
+	float *out = pixels;
+	for(int row = region.top(); row <= region.bottom(); row++)
+	{
+		const unsigned char* pix = d->mQimg->constScanLine(row) + region.left()*view.pixelStride;
+		for(int col = region.left(); col <= region.right(); col++, pix += view.pixelStride)
+			for(int c = 0; c < nbChannels; c++)
+				*out++ = c < 4 ? Private::channel(view, pix, c) : 0.0f;
+	}
+	return true;
+}
+
+//---------------------------------------------------------------------
+
+ImagePlugin::PixelView ImagePluginQt::pixelView() const
+{
+	PixelView view;
+	if(!isDecoded())
+		return view;
 
-	bool useFloat = true;
-	if(!useFloat)
+	// decode() normalized the image : RGBA interleaved, 8 or 16 bits per channel
+	switch(d->mQimg->format())
 	{
-		// This method use bytes [0-255] channels averages computation
-		int somRed = 0, somGreen = 0, somBlue = 0, somAlpha = 0;
-		for(auto pixCoord : pixCoords)
-		{
-			if(d->mQimg->valid(pixCoord.first, pixCoord.second))
-			{
-				QRgb pix  = d->mQimg->pixel(pixCoord.first, pixCoord.second);
-				somRed	 += qRed(pix);
-				somGreen += qGreen(pix);
-				somBlue	 += qBlue(pix);
-				somAlpha += qAlpha(pix);
-				nbPixels ++;
-			}
-			else
-				err = true;
-		}
-		// Convert pixel bytes [0-255] to float precision
-		r = (somRed/nbPixels)/255.0f;
-		g = (somGreen/nbPixels)/255.0f;
-		b = (somBlue/nbPixels)/255.0f;
-		a = (somAlpha/nbPixels)/255.0f;
+	case QImage::Format_RGBA8888 :	view.type = PixelType::UINT8;	break;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+	case QImage::Format_RGBA64 :	view.type = PixelType::UINT16;	break;
+#endif
+	default : return view;
 	}
-	else
+
+	view.channelIndex[0] = 0; view.channelIndex[1] = 1; view.channelIndex[2] = 2; view.channelIndex[3] = 3;
+	view.nbChannels		= 4;
+	view.data			= d->mQimg->constBits();
+	view.rect			= d->mQimg->rect();
+	view.pixelStride	= view.nbChannels * (view.type == PixelType::UINT16 ? 2 : 1);
+	view.rowStride		= d->mQimg->bytesPerLine();
+	return view;
+}
+
+//---------------------------------------------------------------------
+
+bool ImagePluginQt::averagesChannels(const pixelsCoords &pixCoords, float &r, float &g, float &b, float &a) const
+{
+	return averagesChannels(makePixelSpans(pixCoords), r, g, b, a);
+}
+
+//---------------------------------------------------------------------
+
+bool ImagePluginQt::averagesChannels(const pixelSpans &spans, float &r, float &g, float &b, float &a) const
+{
+	if(!isDecoded())
 	{
-		// this method use float [0-1] channel averages computation 
-		for(auto pixCoord : pixCoords)
-		{
-			if(d->mQimg->valid(pixCoord.first, pixCoord.second))
-			{
-				QColor color(d->mQimg->pixel(pixCoord.first, pixCoord.second));
-				r += color.redF();
-				g += color.greenF();
-				b += color.blueF();
-				a += color.alphaF();
-				nbPixels ++;
-			}
-			else
-				err = true;
-		}
-		float scale = 1.0f / float(nbPixels);
-		r = r*scale;
-		g = g*scale;
-		b = b*scale;
-		a = a*scale;
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"]Cannot continue without a valid QImage decoded."<<std::endl;
+		return false;
 	}
 
-	if(err)
-		std::cout<<"["<<FILE_LINE_FUNC_STR<<"] ERROR occured. Some invalid pixel was detected. Averages will be affected."<<std::endl;
-	else
+	// sum the normalized pixels memory with the SIMD kernels
+	if(averagesChannelsFromView(pixelView(), spans, r, g, b, a))
 		return true;
 
+	std::cout<<"["<<FILE_LINE_FUNC_STR<<"] ERROR occured. Some invalid pixel was detected...abort."<<std::endl;
 	return false;
 }
 
@@ -169,7 +525,7 @@ bool ImagePluginQt::averagesChannels(pixelsCoords pixCoords, float &r, float &g,
 
 bool ImagePluginQt::save(QString filename)
 {
-	if(!d->mQimg)
+	if(!decode())
 	{
 		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"]Cannot continue without a valid QImage loaded."<<std::endl;
 		return false;
@@ -190,16 +546,109 @@ bool ImagePluginQt::save(QString filename)
 #include <OpenImageIO/platform.h> // for pixel allocation
 #include <OpenImageIO/imageio.h>
 #include <OpenImageIO/imagebuf.h>
-#include <OpenImageIO/imagebufalgo.h>
 
 OIIO_NAMESPACE_USING;
 
+namespace
+{
+	// ImageInput::open() return an owning unique_ptr since OIIO 2.0
+#if OIIO_VERSION >= 20000
+	typedef ImageInput::unique_ptr ImageInputPtr;
+	ImageInputPtr openImageInput(const std::string &filename, const ImageSpec *config = nullptr) {return ImageInput::open(filename, config);}
+#else
+	typedef std::shared_ptr<ImageInput> ImageInputPtr;
+	ImageInputPtr openImageInput(const std::string &filename, const ImageSpec *config = nullptr) {return ImageInputPtr(ImageInput::open(filename, config), [](ImageInput *in){if(in) ImageInput::destroy(in);});}
+#endif
+
+	/// format of the decoded buffer : the file one when the measurement kernels handle it (no float promotion), float otherwise
+	TypeDesc decodeFormat(const ImageSpec &spec)
+	{
+		switch(spec.format.basetype)
+		{
+		case TypeDesc::UINT8	:
+		case TypeDesc::UINT16	:
+		case TypeDesc::HALF		:
+		case TypeDesc::FLOAT	: return spec.format;
+		default					: return TypeDesc::FLOAT;
+		}
+	}
+
+	/// colorspace conversion of a decoded buffer and its QImage (nullptr until toQImage) kept in the DecodedImageCache
+	struct ColorSpaceVariant
+	{
+		std::shared_ptr<ImageBuf>	mBuf;	///< never written once cached
+		std::shared_ptr<QImage>		mQimg;
+	};
+
+	/// float [0-1] to 8 bits conversion table (values are clamped, 4096 steps is finer than the 8 bits output)
+	class Float8BitLUT
+	{
+	public:
+		static const Float8BitLUT& instance() {static const Float8BitLUT lut; return lut;}
+
+		unsigned char operator()(float value) const
+		{
+			if(!(value > 0.0f))	// also NaN
+				return 0;
+			return value >= 1.0f ? 255 : mTable[int(value * Steps + 0.5f)];
+		}
+
+	private:
+		static const int Steps = 4096;
+		Float8BitLUT()
+		{
+			for(int i = 0; i <= Steps; i++)
+				mTable[i] = (unsigned char)(i * 255.0f / Steps + 0.5f);
+		}
+		unsigned char mTable[Steps+1];
+	};
+}
+
 class ImagePluginOIIO::Private
 {
+public:
+	Private() : mState(LoadState::Unopened), mCache(nullptr), mImgBufCache(nullptr)
+	{}
 public:
 	std::string					mCurrentFileName;
 	std::shared_ptr<ImageBuf>	mImgBuf;
-	std::shared_ptr<QImage>		mQimg;
+	std::shared_ptr<QImage>		mQimg;		///< QImage conversion of the current buffer (reset when the buffer change)
+	LoadState					mState;		///< read methods never move it : the file is never read again after decode()
+	ImageCache*					mCache;		///< shared ImageCache to use at next loadImage (nullptr : decode in a local float buffer)
+	ImageCache*					mImgBufCache;	///< ImageCache backing mImgBuf
+	QSize						mSize;			///< image size read from the header by loadImage (mImgBuf may only hold a decoded region)
+
+	std::shared_ptr<ImageBuf>	mDecodedBuf;	///< pristine decoded buffer kept while mImgBuf is a colorspace variant (converted from it)
+	std::shared_ptr<QImage>		mDecodedQimg;	///< QImage conversion of mDecodedBuf
+	DecodedImageCache::Key		mVariantKey;	///< DecodedImageCache key of the current colorspace variant (Converted state only)
+
+	/// DecodedImageCache key of the mDecodedBuf conversion to colorSpace (the decoded region is part of it)
+	DecodedImageCache::Key variantKey(const QString &colorSpace) const
+	{
+		const ImageSpec &spec = mDecodedBuf->spec();
+		return DecodedImageCache::makeKey(QString::fromStdString(mCurrentFileName),
+			QString("OIIO variant %1,%2 %3x%4").arg(spec.x).arg(spec.y).arg(spec.width).arg(spec.height), colorSpace);
+	}
+
+	/// read float pixels of buf (mImgBuf by default) : ImageCache::get_pixels for a cache-backed buffer (thread-safe, tiles paged in on demand), ImageBuf otherwise
+	bool getPixels(const ImageBuf &buf, const ROI &roi, float *pixels, stride_t xstride = AutoStride, stride_t ystride = AutoStride) const
+	{
+		if(mImgBufCache != nullptr && buf.storage() == ImageBuf::IMAGECACHE)
+			return mImgBufCache->get_pixels(ustring(mCurrentFileName), 0, 0, roi.xbegin, roi.xend, roi.ybegin, roi.yend, 0, 1,
+				roi.chbegin, roi.chend, TypeDesc::FLOAT, pixels, xstride, ystride);
+		return buf.get_pixels(roi, TypeDesc::FLOAT, pixels, xstride, ystride);
+	}
+	bool getPixels(const ROI &roi, float *pixels, stride_t xstride = AutoStride, stride_t ystride = AutoStride) const
+	{
+		return getPixels(*mImgBuf, roi, pixels, xstride, ystride);
+	}
+
+	/// the read methods only access pixels decoded in memory (ImageBuf would silently return black outside)
+	bool isInDecodedRegion(const QRect &region) const
+	{
+		const ImageSpec &spec = mImgBuf->spec();
+		return QRect(spec.x, spec.y, spec.width, spec.height).contains(region);
+	}
 };
 
 //---------------------------------------------------------------------
@@ -217,6 +666,31 @@ ImagePluginOIIO::~ImagePluginOIIO()
 	delete d;
 }
 
+bool ImagePluginOIIO::oiioProgress(void *plugin, float done)
+{
+	return static_cast<const ImagePluginOIIO*>(plugin)->progress(done);
+}
+
+//---------------------------------------------------------------------
+
+void ImagePluginOIIO::useImageCache(float maxMemoryMB, int autotile)
+{
+	if(maxMemoryMB <= 0.0f)
+	{
+		d->mCache = nullptr;
+		return;
+	}
+	// process-wide cache : every plugin (and so every ColorSwatch run) using it share the same tiles and memory budget
+	d->mCache = ImageCache::create(true);
+	d->mCache->attribute("max_memory_MB", maxMemoryMB);
+	d->mCache->attribute("autotile", autotile);
+}
+
+bool ImagePluginOIIO::withImageCache() const
+{
+	return d->mCache != nullptr;
+}
+
 //---------------------------------------------------------------------
 
 QString ImagePluginOIIO::getImageFilterExtensions()	// needed format: 'Image (*.png *.jpg *.bmp)')
@@ -244,179 +718,561 @@ QString ImagePluginOIIO::getImageFilterExtensions()	// needed format: 'Image (*.
 
 //---------------------------------------------------------------------
 
+ImagePlugin::ImageInfo ImagePluginOIIO::probe(QString filename) const
+{
+	ImageInfo info;
+	ImageInputPtr in = openImageInput(filename.toStdString());
+	if(!in)
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] cannot open "<<filename.toStdString()<<": "<<geterror()<<std::endl;
+		return info;
+	}
+	const ImageSpec &spec = in->spec();
+	info.width			= spec.width;
+	info.height			= spec.height;
+	info.nbChannels		= spec.nchannels;
+	info.bitDepth		= spec.get_int_attribute("oiio:BitsPerSample", int(spec.format.size()*8));
+	info.colorSpace		= QString::fromStdString(spec.get_string_attribute("oiio:ColorSpace"));
+	info.exposureTime	= spec.get_float_attribute("ExposureTime");
+	info.fNumber		= spec.get_float_attribute("FNumber");
+	info.isoSpeed		= spec.get_int_attribute("Exif:ISOSpeedRatings");
+	in->close();
+	return info;
+}
+
+//---------------------------------------------------------------------
+
 bool ImagePluginOIIO::loadImage(QString filename)
 {
 	d->mCurrentFileName = filename.toStdString();
-	d->mImgBuf.reset( new ImageBuf(d->mCurrentFileName) );
+	d->mImgBuf.reset( d->mCache ? new ImageBuf(d->mCurrentFileName, d->mCache) : new ImageBuf() );
+	d->mImgBufCache = d->mCache;
 	d->mQimg.reset();
-	return d->mImgBuf.get() ? true : false;
+	d->mDecodedBuf.reset();
+	d->mDecodedQimg.reset();
+	d->mState = LoadState::Unopened;
+	d->mSize = QSize();
+	mColorSpace = "Linear";
+
+	// only read the header (spec) of the first subimage
+	if(!d->mImgBuf->init_spec(d->mCurrentFileName, 0, 0))
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] cannot open "<<d->mCurrentFileName<<": "<<d->mImgBuf->geterror()<<std::endl;
+		return false;
+	}
+	d->mSize = QSize(d->mImgBuf->spec().width, d->mImgBuf->spec().height);
+	d->mState = LoadState::HeaderOnly;
+	return true;
 }
 
 //---------------------------------------------------------------------
 
-QImage ImagePluginOIIO::toQImage()
+bool ImagePluginOIIO::decode()
 {
-	if(d->mImgBuf == nullptr)
+	if(isDecoded())
+		return true;
+	if(d->mState != LoadState::HeaderOnly)
 	{
-		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"]image not loaded...abort."<<std::endl;
-		return QImage();
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] image not loaded...abort."<<std::endl;
+		return false;
 	}
 
-	// shortcut necessary to avoid reloading same images each time we need it (Qt GUI resize event)
-	if(d->mQimg != nullptr)
-		return *d->mQimg.get();
+	// ImageCache mode : keep the buffer backed by the cache (no conversion), pixels are only paged in when read
+	// otherwise force a local buffer in the file format (uint8, uint16, half or float), so pixelView() can expose it to the kernels
+	// and concurrent reads never go through the ImageCache
+	if(progress(0.0f))
+		return false;
 
-	bool useNative = false;
-	ImageSpec spec = (useNative ? d->mImgBuf->nativespec() : d->mImgBuf->spec());
-	//std::cout<<"file format name :"<<d->mImgBuf->file_format_name()<<std::endl;
-	//std::cout<<(useNative?"native format ":"format ")<<spec.format<<std::endl;
-	if(spec.nchannels < 3)
+	// local buffers are shared with the DecodedImageCache : they are never written once decoded (colorSpaceConversion write a new buffer)
+	DecodedImageCache::Key key = DecodedImageCache::makeKey(QString::fromStdString(d->mCurrentFileName), "OIIO", QString()); // as decoded (variants are keyed by colorSpaceConversion)
+	if(!d->mImgBufCache)
 	{
-		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"]Only channels numbers > 3 is allowed for QImage conversion...abort."<<std::endl;
-		return QImage();
+		if(std::shared_ptr<const ImageBuf> cached = DecodedImageCache::instance().find<ImageBuf>(key))
+		{
+			d->mImgBuf	= std::const_pointer_cast<ImageBuf>(cached);
+			d->mState	= LoadState::Decoded;
+			progress(1.0f);
+			return true;
+		}
 	}
 
-	d->mQimg.reset(new QImage(spec.width, spec.height, QImage::Format_RGB32) );
-
-	/* // this code could be use if you use (instead of imageBuf) ImageInput pointer : d->mImgIn.reset(ImageInput::open(d->mCurrentFileName));
-	int ncTot	= spec.nchannels;
-	int nc3		= std::min(3, ncTot);			// we only need RGB channel data for Format_RGB32
-	std::vector<float> scanline( spec.width * ncTot);
-	for( int row = 0; row < spec.height; row++ )
+	// the disk cache entry is wrapped by the buffer (read-only mapping, never written once decoded) and released with it
+	TypeDesc	format		= decodeFormat(d->mImgBuf->spec());
+	QString		diskEntry	= d->mImgBufCache ? QString() : DiskImageCache::instance().entryPath(QString::fromStdString(d->mCurrentFileName), "OIIO",
+		QString(format.c_str()));
+	if(std::shared_ptr<const DiskImageCache::Mapping> mapping = DiskImageCache::instance().map(diskEntry))
 	{
-		d->mImgIn->read_scanline( row+spec.y, 0+spec.z, TypeDesc::FLOAT, &scanline[0] );
-		for( int col = 0; col < spec.width; col++ )
+		const DiskImageCache::Header &header = mapping->header();
+		ImageSpec spec = d->mImgBuf->spec();
+		spec.set_format(format);
+		if(header.width == spec.width && header.height == spec.height && header.nbChannels == spec.nchannels
+			&& header.format == int(format.basetype) && header.bytesPerLine == quint64(spec.scanline_bytes()))
 		{
-			float rgb[3] = { 0, 0, 0 };
-			for(int i=0; i<nc3; ++i)
-				rgb[i] = scanline[col*ncTot+i];
-
-			QColor color;
-			color.setRedF	(rgb[0]);
-			color.setGreenF	(rgb[1]);
-			color.setBlueF	(rgb[2]);
-
-			d->mQimg->setPixel(col, row, color.rgb());
+			d->mImgBuf.reset(new ImageBuf(spec, const_cast<uchar*>(mapping->pixels())), [mapping](ImageBuf *buf){ delete buf; });
+			DecodedImageCache::instance().insert(key, std::shared_ptr<const ImageBuf>(d->mImgBuf), spec.image_bytes());
+			d->mState = LoadState::Decoded;
+			progress(1.0f);
+			return true;
 		}
 	}
-	*/
 
-	// TODO: try to add progress callback to read() function
-	if( !d->mImgBuf->read(0, 0, false, spec.format) ) //spec.format //TypeDesc::BASETYPE::FLOAT
-		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"]Cannot read imageBuf...abort."<<std::endl;
+	bool isRead = d->mImgBufCache ? d->mImgBuf->read(0, 0, false, TypeDesc::UNKNOWN)
+		: d->mImgBuf->read(0, 0, true, format, &ImagePluginOIIO::oiioProgress, this);
+	if(!isRead)
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] cannot decode image (or cancelled): "<<d->mImgBuf->geterror()<<std::endl;
+		loadImage(QString::fromStdString(d->mCurrentFileName)); // a cancelled read leave a partial buffer : back to the header only
+		return false;
+	}
+	if(!d->mImgBufCache)
+		DecodedImageCache::instance().insert(key, std::shared_ptr<const ImageBuf>(d->mImgBuf), d->mImgBuf->spec().image_bytes());
+	if(!diskEntry.isEmpty())
+	{
+		const ImageSpec &spec = d->mImgBuf->spec();
+		DiskImageCache::Header header;
+		header.width		= spec.width;
+		header.height		= spec.height;
+		header.nbChannels	= spec.nchannels;
+		header.format		= int(spec.format.basetype);
+		header.bytesPerLine	= quint64(spec.scanline_bytes());
+		DiskImageCache::instance().store(diskEntry, header, static_cast<const uchar*>(static_cast<const ImageBuf&>(*d->mImgBuf).localpixels()));
+	}
+	d->mState = LoadState::Decoded;
+	return true;
+}
 
-	// This switch demonstrate how to manipulate specific data format or to handle directly default floating pixel format (conversion is auto handled internaly)
-	switch(spec.format.basetype)
+bool ImagePluginOIIO::decodeRegion(const QRect &region)
+{
+	if(isDecoded())
+		return d->isInDecodedRegion(region);
+	if(d->mState != LoadState::HeaderOnly)
 	{
-	case TypeDesc::BASETYPE::FLOAT : 
-		{
-			// ImageBuf iterator is based on <BUFT,USERT=float> the type of data stored in buffer AND the type of retrive data you want to manipulate
-			for( ImageBuf::ConstIterator<float> it(*d->mImgBuf.get()); !it.done(); ++it)
-			{
-				QColor color;// float [0-1]
-				color.setRedF	(it[0]);
-				color.setGreenF	(it[1]);
-				color.setBlueF	(it[2]);
-				d->mQimg->setPixel(it.x(), it.y(), color.rgb());
-			}
-			break;
-		}
-	case TypeDesc::BASETYPE::UINT8 :
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] image not loaded...abort."<<std::endl;
+		return false;
+	}
+	if(d->mImgBufCache)
+		return decode(); // the ImageCache already only read the tiles which are accessed
+
+	ImageInputPtr in = openImageInput(d->mCurrentFileName);
+	if(!in)
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] cannot open "<<d->mCurrentFileName<<": "<<geterror()<<std::endl;
+		return false;
+	}
+	const ImageSpec	&spec	= in->spec();
+	QRect			roi		= region.intersected(QRect(spec.x, spec.y, spec.width, spec.height));
+	if(roi.isEmpty())
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] region is outside of the image...abort."<<std::endl;
+		return false;
+	}
+	if(roi == QRect(spec.x, spec.y, spec.width, spec.height))
+	{
+		in->close();
+		return decode();
+	}
+
+	// local buffer (file format) only as large as the region (keep the image coord system and display window)
+	TypeDesc format		= decodeFormat(spec);
+	ImageSpec roiSpec	= spec;
+	roiSpec.x			= roi.x();
+	roiSpec.y			= roi.y();
+	roiSpec.width		= roi.width();
+	roiSpec.height		= roi.height();
+	roiSpec.tile_width	= roiSpec.tile_height = roiSpec.tile_depth = 0;
+	roiSpec.set_format(format);
+	std::shared_ptr<ImageBuf> roiBuf( new ImageBuf(roiSpec) );
+
+	int		nc		= spec.nchannels;
+	bool	isRead	= !progress(0.0f);
+	if(isRead && spec.tile_width == 0)
+	{
+		// scanlines file : only decode the region rows, by bands of full rows
+		const int			bandHeight	= 64;
+		const std::size_t			pixelSize	= format.size() * nc;
+		std::vector<unsigned char>	band(std::size_t(spec.width) * pixelSize * bandHeight);
+		for(int y = roi.top(); isRead && y <= roi.bottom(); y += bandHeight)
 		{
-			for( ImageBuf::ConstIterator<unsigned char, unsigned char> it(*d->mImgBuf.get()); !it.done(); ++it)
-			{
-				QColor color(it[0], it[1], it[2]); // UINT8 [0-255]
-				d->mQimg->setPixel(it.x(), it.y(), color.rgb());
-			}
-			break;
+			int yEnd = std::min(y + bandHeight, roi.bottom()+1);
+			isRead = in->read_scanlines(y, yEnd, spec.z, 0, nc, format, band.data())
+				&& roiBuf->set_pixels(ROI(roi.left(), roi.right()+1, y, yEnd, 0, 1, 0, nc), format,
+					band.data() + std::size_t(roi.left() - spec.x) * pixelSize, AutoStride, stride_t(spec.width * pixelSize))
+				&& !progress(float(yEnd - roi.top()) / roi.height());
 		}
-	default:
+	}
+	else if(isRead)
+	{
+		// tiled file : only decode the tiles covering the region (read_tiles need tile aligned bounds or the image end)
+		int xBegin	= spec.x + (roi.left()  - spec.x) / spec.tile_width  * spec.tile_width;
+		int yBegin	= spec.y + (roi.top()   - spec.y) / spec.tile_height * spec.tile_height;
+		int xEnd	= std::min(spec.x + spec.width,  spec.x + (roi.right()  - spec.x + spec.tile_width)  / spec.tile_width  * spec.tile_width);
+		int yEnd	= std::min(spec.y + spec.height, spec.y + (roi.bottom() - spec.y + spec.tile_height) / spec.tile_height * spec.tile_height);
+		const std::size_t			pixelSize	= format.size() * nc;
+		std::vector<unsigned char>	tiles(std::size_t(xEnd - xBegin) * (yEnd - yBegin) * pixelSize);
+		isRead = in->read_tiles(xBegin, xEnd, yBegin, yEnd, spec.z, spec.z+1, 0, nc, format, tiles.data())
+			&& roiBuf->set_pixels(ROI(roi.left(), roi.right()+1, roi.top(), roi.bottom()+1, 0, 1, 0, nc), format,
+				tiles.data() + (std::size_t(roi.top() - yBegin) * (xEnd - xBegin) + (roi.left() - xBegin)) * pixelSize, AutoStride, stride_t((xEnd - xBegin) * pixelSize))
+			&& !progress(1.0f);
+	}
+	if(!isRead)
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] cannot decode region (or cancelled): "<<in->geterror()<<roiBuf->geterror()<<std::endl;
+		return false;
+	}
+	in->close();
+
+	d->mImgBuf	= roiBuf;
+	d->mState	= LoadState::Decoded;
+	return true;
+}
+
+QRect ImagePluginOIIO::decodedRegion() const
+{
+	if(!isDecoded())
+		return QRect();
+	const ImageSpec &spec = d->mImgBuf->spec();
+	return QRect(spec.x, spec.y, spec.width, spec.height);
+}
+
+ImagePlugin::LoadState ImagePluginOIIO::loadState() const
+{
+	return d->mState;
+}
+
+ImagePlugin::PixelType ImagePluginOIIO::decodedType() const
+{
+	if(!isDecoded())
+		return PixelType::UNKNOWN;
+	switch(d->mImgBuf->spec().format.basetype)
+	{
+	case TypeDesc::UINT8:	return PixelType::UINT8;
+	case TypeDesc::UINT16:	return PixelType::UINT16;
+	case TypeDesc::HALF:	return PixelType::HALF;
+	case TypeDesc::FLOAT:	return PixelType::FLOAT;
+	default:				return PixelType::UNKNOWN;
+	}
+}
+
+//---------------------------------------------------------------------
+
+QImage ImagePluginOIIO::toQImage()
+{
+	if(d->mState == LoadState::Unopened)
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"]image not loaded...abort."<<std::endl;
+		return QImage();
+	}
+
+	// shortcut necessary to avoid converting same buffer each time we need it (Qt GUI resize event)
+	if(d->mQimg != nullptr)
+		return *d->mQimg.get();
+
+	if( !decode() )
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"]Cannot read imageBuf...abort."<<std::endl;
+		return QImage();
+	}
+
+	const ImageSpec &spec = d->mImgBuf->spec();
+	if(spec.nchannels < 3)
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"]Only channels numbers > 3 is allowed for QImage conversion...abort."<<std::endl;
+		return QImage();
+	}
+
+	// the image coord system is kept : a region decode is shown at its place on a black canvas
+	std::shared_ptr<QImage> qimg(new QImage(spec.full_width, spec.full_height, QImage::Format_RGB32));
+	qimg->fill(Qt::black);
+	QRect canvas	(spec.full_x, spec.full_y, spec.full_width, spec.full_height);
+	QRect rows		= QRect(spec.x, spec.y, spec.width, spec.height).intersected(canvas);
+	if(rows.isEmpty())
+		return *(d->mQimg = qimg);
+
+	// whole rows are converted at once : get_pixels (any buffer format) into a float RGB row, then LUT to 8 bits straight into the QImage memory.
+	// Row bands are converted in parallel (bits() is called once here, so no thread detach the QImage)
+	// progress is only reported from the calling thread (the workers only count the bands done)
+	unsigned char*		bits			= qimg->bits();
+	const int			bytesPerLine	= qimg->bytesPerLine();
+	const int			bandHeight		= 64;
+	const int			nbBands			= (rows.height() + bandHeight-1) / bandHeight;
+	const Float8BitLUT	&lut			= Float8BitLUT::instance();
+	const std::thread::id callerId		= std::this_thread::get_id();
+	std::atomic<bool>	isConverted		(true);
+	std::atomic<bool>	isCancelled		(progress(0.0f));
+	std::atomic<int>	nbBandsDone		(0);
+	parallelFor(nbBands, 0, [&](int band)
 		{
-			std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] "<<spec.format<<" format is not yet handled here. Try forcing float format."<<std::endl;
-			d->mImgBuf->reset(d->mCurrentFileName);
-			if(d->mImgBuf->read(0, 0, true, TypeDesc::BASETYPE::FLOAT)) // force FLOAT buffer convertion
+			if(isCancelled)
+				return;
+			if(std::this_thread::get_id() == callerId && progress(float(nbBandsDone) / nbBands))
+				isCancelled = true;
+			std::vector<float> row(std::size_t(rows.width()) * 3);
+			int yEnd = std::min(rows.top() + (band+1)*bandHeight, rows.bottom()+1);
+			for(int y = rows.top() + band*bandHeight; y < yEnd; y++)
 			{
-				for( ImageBuf::ConstIterator<float> it(*d->mImgBuf.get()); !it.done(); ++it)
+				if(!d->getPixels(ROI(rows.left(), rows.right()+1, y, y+1, 0, 1, 0, 3), row.data()))
 				{
-					QColor color;	// float [0-1]
-					color.setRedF	(it[0]);
-					color.setGreenF	(it[1]);
-					color.setBlueF	(it[2]);
-					d->mQimg->setPixel(it.x(), it.y(), color.rgb());
+					isConverted = false;
+					return;
 				}
+				QRgb* line = reinterpret_cast<QRgb*>(bits + std::size_t(y - canvas.top()) * bytesPerLine) + (rows.left() - canvas.left());
+				for(int x = 0; x < rows.width(); x++)
+					line[x] = qRgb(lut(row[3*x]), lut(row[3*x+1]), lut(row[3*x+2]));
 			}
-			else
-			{
-				std::cerr<<"["<<FILE_LINE_FUNC_STR<<"]"<<"Failed to read...abort"<<std::endl;
-				return QImage();
-			}
+			nbBandsDone++;
 		}
+	);
+	if(isCancelled)
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] QImage conversion cancelled."<<std::endl;
+		return QImage();
+	}
+	if(!isConverted)
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] cannot read pixels: "<<d->mImgBuf->geterror()<<std::endl;
+	progress(1.0f);
+
+	d->mQimg = qimg;
+
+	// kept with the buffer it comes from : switching colorspaces back and forth doesn't convert it again
+	if(d->mState == LoadState::Converted)
+	{
+		struct ColorSpaceVariant variant = {d->mImgBuf, d->mQimg};
+		DecodedImageCache::instance().insert(d->mVariantKey, std::make_shared<const ColorSpaceVariant>(variant),
+			d->mImgBuf->spec().image_bytes() + qimageBytes(*d->mQimg));
 	}
+	else if(d->mImgBuf == d->mDecodedBuf)
+		d->mDecodedQimg = d->mQimg;
 
 	return *d->mQimg.get();
 }
 
 //---------------------------------------------------------------------
 
-QSize ImagePluginOIIO::size()
+QImage ImagePluginOIIO::preview(const QSize &maxSize) const
 {
-	if(d->mImgBuf == nullptr)
+	// only the file name is used : it can run while an other thread decode the image
+	if(d->mCurrentFileName.empty())
+		return QImage();
+
+	// raw files : ask for an half size demosaic (ignored by the OIIO versions without this raw hint)
+	ImageSpec config;
+	config.attribute("raw:HalfSize", 1);
+	ImageInputPtr in = openImageInput(d->mCurrentFileName, &config);
+	if(!in)
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] cannot open "<<d->mCurrentFileName<<": "<<geterror()<<std::endl;
+		return QImage();
+	}
+
+	ImageBuf	small;
+	ImageSpec	spec = in->spec();
+#if OIIO_VERSION >= 20300
+	// embedded thumbnail (EXIF, raw) when it is large enough
+	if(in->get_thumbnail(small, 0) && small.initialized() && (small.spec().width < maxSize.width() && small.spec().height < maxSize.height()))
+		small.clear();
+#endif
+	if(!small.initialized())
+	{
+		// smallest MIP level still larger than maxSize (level 0 when there isn't any)
+		int level = 0;
+		ImageSpec levelSpec;
+		while(in->seek_subimage(0, level+1, levelSpec) && levelSpec.width >= maxSize.width() && levelSpec.height >= maxSize.height())
+		{
+			spec = levelSpec;
+			level++;
+		}
+		in->seek_subimage(0, level, spec);
+
+		// a large non MIP-mapped file readable by Qt (jpeg, png...) : QImageReader may decode it directly scaled down
+		QImageReader reader(QString::fromStdString(d->mCurrentFileName));
+		if(level == 0 && in->format_name() != std::string("raw") && reader.canRead())
+		{
+			in->close();
+			if(spec.width > maxSize.width() || spec.height > maxSize.height())
+				reader.setScaledSize(QSize(spec.width, spec.height).scaled(maxSize, Qt::KeepAspectRatio));
+			return reader.read();
+		}
+
+		// 8 bits is enough for a display
+		spec.set_format(TypeDesc::UINT8);
+		small.reset(spec);
+		if(!in->read_image(TypeDesc::UINT8, small.localpixels()))
+		{
+			std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] cannot read preview: "<<in->geterror()<<std::endl;
+			return QImage();
+		}
+	}
+	in->close();
+
+	const ImageSpec &smallSpec = small.spec();
+	if(smallSpec.nchannels < 3)
+		return QImage();
+	QImage img(smallSpec.width, smallSpec.height, QImage::Format_RGB32);
+	std::vector<unsigned char> row(std::size_t(smallSpec.width) * 3);
+	for(int y = 0; y < smallSpec.height; y++)
+	{
+		small.get_pixels(ROI(smallSpec.x, smallSpec.x+smallSpec.width, smallSpec.y+y, smallSpec.y+y+1, 0, 1, 0, 3), TypeDesc::UINT8, row.data());
+		QRgb* line = reinterpret_cast<QRgb*>(img.scanLine(y));
+		for(int x = 0; x < smallSpec.width; x++)
+			line[x] = qRgb(row[3*x], row[3*x+1], row[3*x+2]);
+	}
+	return img.size().boundedTo(maxSize) == img.size() ? img : img.scaled(maxSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+}
+
+//---------------------------------------------------------------------
+
+QSize ImagePluginOIIO::size() const
+{
+	if(d->mState == LoadState::Unopened)
 	{
 		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"]image not loaded...abort."<<std::endl;
 		return QSize();
 	}
-	return QSize(d->mImgBuf->spec().width, d->mImgBuf->spec().height);
+	return d->mSize;
 }
 
 //---------------------------------------------------------------------
 
-float ImagePluginOIIO::readSinglePixelChannel(int x, int y, int channel)
+float ImagePluginOIIO::readSinglePixelChannel(int x, int y, int channel) const
 {
-	if(d->mImgBuf == nullptr)
+	if(!isDecoded())
 	{
-		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] image not loaded...abort."<<std::endl;
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] image not decoded...abort."<<std::endl;
 		return false;
 	}
 
-	if(!d->mImgBuf->initialized())
-		d->mImgBuf->read(0, 0, true, TypeDesc::BASETYPE::FLOAT);
+
+	if(!d->isInDecodedRegion(QRect(x, y, 1, 1)))
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] pixel is outside of the decoded region...abort."<<std::endl;
+		return false;
+	}
 
 	int nc = d->mImgBuf->nchannels();
 	float* pixel = OIIO_ALLOCA(float,nc);
-	d->mImgBuf->getpixel(x, y, pixel);
+	if(channel < 0 || channel >= nc || !d->getPixels(ROI(x, x+1, y, y+1, 0, 1, 0, nc), pixel))
+		return 0.0f;
 	return pixel[channel];
 }
 
 //---------------------------------------------------------------------
 
-bool ImagePluginOIIO::averagesChannels(pixelsCoords pixCoords, float &r, float &g, float &b, float &a)
+bool ImagePluginOIIO::readRegion(const QRect &region, float *pixels, int nbChannels) const
 {
-	if(d->mImgBuf == nullptr)
+	if(!isDecoded())
 	{
-		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] image not loaded...abort."<<std::endl;
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] image not decoded...abort."<<std::endl;
 		return false;
 	}
-	
-	if(!d->mImgBuf->read(0,0,false,TypeDesc::FLOAT))
+	if(pixels == nullptr || nbChannels < 1)
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] output buffer is invalid...abort."<<std::endl;
+		return false;
+	}
+	if(!d->isInDecodedRegion(region))
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] region is outside of the decoded region...abort."<<std::endl;
+		return false;
+	}
+
+
+	// one get_pixels call per region : OIIO convert and interleave the channels directly into the caller buffer
+	int nc = std::min(d->mImgBuf->nchannels(), nbChannels);
+	ROI roi(region.left(), region.right()+1, region.top(), region.bottom()+1, 0, 1, 0, nc);
+	if(!d->getPixels(roi, pixels, nbChannels*sizeof(float)))
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] cannot read region: "<<d->mImgBuf->geterror()<<std::endl;
+		return false;
+	}
+
+	// fill channels the image doesn't have
+	if(nc < nbChannels)
+	{
+		size_t nbPixels = size_t(region.width()) * size_t(region.height());
+		for(size_t i = 0; i < nbPixels; i++)
+			for(int c = nc; c < nbChannels; c++)
+				pixels[i*nbChannels + c] = c == 3 ? 1.0f : 0.0f;
+	}
+	return true;
+}
+
+//---------------------------------------------------------------------
+
+ImagePlugin::PixelView ImagePluginOIIO::pixelView() const
+{
+	PixelView view;
+	if(!isDecoded())
+		return view;
+
+
+	// only a buffer held in memory by the ImageBuf can be exposed (not one backed by the ImageCache)
+	const ImageBuf &imgBuf	= *d->mImgBuf.get();
+	const void *localPixels	= imgBuf.localpixels();
+	if(localPixels == nullptr)
+		return view;
+
+	const ImageSpec &spec = imgBuf.spec();
+	switch(spec.format.basetype)
+	{
+	case TypeDesc::BASETYPE::UINT8	: view.type = PixelType::UINT8;		break;
+	case TypeDesc::BASETYPE::UINT16	: view.type = PixelType::UINT16;	break;
+	case TypeDesc::BASETYPE::HALF	: view.type = PixelType::HALF;		break;
+	case TypeDesc::BASETYPE::FLOAT	: view.type = PixelType::FLOAT;		break;
+	default : return view;
+	}
+
+	view.data			= static_cast<const unsigned char*>(localPixels);
+	view.rect			= QRect(spec.x, spec.y, spec.width, spec.height);
+	view.nbChannels		= spec.nchannels;
+	view.pixelStride	= imgBuf.pixel_stride();
+	view.rowStride		= imgBuf.scanline_stride();
+	for(int c = 0; c < 4; c++)
+		view.channelIndex[c] = c < spec.nchannels ? c : -1;
+	if(spec.nchannels <= 2) // gray (+alpha) image
+	{
+		view.channelIndex[3] = spec.nchannels == 2 ? 1 : -1;
+		view.channelIndex[0] = view.channelIndex[1] = view.channelIndex[2] = 0;
+	}
+	return view;
+}
+
+//---------------------------------------------------------------------
+
+bool ImagePluginOIIO::averagesChannels(const pixelsCoords &pixCoords, float &r, float &g, float &b, float &a) const
+{
+	if(!isDecoded())
 	{
-		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] image buffer can't read image...abort."<<std::endl;
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] image not decoded...abort."<<std::endl;
 		return false;
 	}
+	
+	// sum the decoded pixels memory with the SIMD kernels
+	if(averagesChannelsFromView(pixelView(), makePixelSpans(pixCoords), r, g, b, a))
+		return true;
 
 	int nc = d->mImgBuf->nchannels();
-	std::vector<float> total (nc, 0.0f);
+	std::vector<float> total (std::max(nc, 4), 0.0f);
+	float* pixel = OIIO_ALLOCA(float,nc);
 	for(auto pixCoord : pixCoords)
 	{
-		float* pixel = OIIO_ALLOCA(float,nc);
-		d->mImgBuf->getpixel(pixCoord.first, pixCoord.second, pixel);
-		for (int c = 0; c <= nc; c++)
+		if(!d->isInDecodedRegion(QRect(pixCoord.first, pixCoord.second, 1, 1)))
+		{
+			std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] pixel is outside of the decoded region...abort."<<std::endl;
+			return false;
+		}
+		if(!d->getPixels(ROI(pixCoord.first, pixCoord.first+1, pixCoord.second, pixCoord.second+1, 0, 1, 0, nc), pixel))
+		{
+			std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] cannot read pixel: "<<d->mImgBuf->geterror()<<std::endl;
+			return false;
+		}
+		for (int c = 0; c < nc; c++)
 			total[c] += pixel[c];
 	}
 
 	r = total[0]/float(pixCoords.size());
 	g = total[1]/float(pixCoords.size());
 	b = total[2]/float(pixCoords.size());
-	if(nc>=3)
+	if(nc>3)
 		a = total[3]/float(pixCoords.size());
 
 	return true;
@@ -424,6 +1280,151 @@ bool ImagePluginOIIO::averagesChannels(pixelsCoords pixCoords, float &r, float &
 
 //---------------------------------------------------------------------
 
+bool ImagePluginOIIO::averagesChannels(const pixelSpans &spans, float &r, float &g, float &b, float &a) const
+{
+	if(!isDecoded())
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] image not decoded...abort."<<std::endl;
+		return false;
+	}
+
+	// sum the decoded pixels memory with the SIMD kernels
+	if(averagesChannelsFromView(pixelView(), spans, r, g, b, a))
+		return true;
+
+	// other layouts : one get_pixels per span into a float row buffer
+	int nc = std::min(d->mImgBuf->nchannels(), 4);
+	std::vector<float>	row;
+	double				sums[4]		= {0, 0, 0, 0};
+	std::size_t			nbPixels	= 0;
+	for(const PixelSpan &span : spans)
+	{
+		if(span.width() <= 0)
+			continue;
+		if(!d->isInDecodedRegion(QRect(span.xBegin, span.row, span.width(), 1)))
+		{
+			std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] pixels are outside of the decoded region...abort."<<std::endl;
+			return false;
+		}
+		row.resize(std::size_t(span.width()) * nc);
+		if(!d->getPixels(ROI(span.xBegin, span.xEnd, span.row, span.row+1, 0, 1, 0, nc), row.data()))
+		{
+			std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] cannot read pixels: "<<d->mImgBuf->geterror()<<std::endl;
+			return false;
+		}
+		for(int i = 0; i < span.width(); i++)
+			for(int c = 0; c < nc; c++)
+				sums[c] += row[i*nc + c];
+		nbPixels += std::size_t(span.width());
+	}
+	if(nbPixels == 0)
+		return false;
+
+	r = float(sums[0]/nbPixels);
+	g = float(sums[1]/nbPixels);
+	b = float(sums[2]/nbPixels);
+	if(nc>3)
+		a = float(sums[3]/nbPixels);
+	return true;
+}
+
+//---------------------------------------------------------------------
+
+bool ImagePluginOIIO::streamAveragesChannels(const std::vector<pixelSpans> &spansLists, std::vector<float> &averages)
+{
+	if(d->mState == LoadState::Unopened)
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] image not loaded...abort."<<std::endl;
+		return false;
+	}
+	ImageInputPtr in = openImageInput(d->mCurrentFileName);
+	if(!in)
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] cannot open "<<d->mCurrentFileName<<": "<<geterror()<<std::endl;
+		return false;
+	}
+	const ImageSpec &spec	= in->spec();
+	const int		nc		= std::min(spec.nchannels, 4);
+	const QRect		image	(spec.x, spec.y, spec.width, spec.height);
+
+	// spans of each row (tagged with their list) : each band only visit its rows
+	struct RowSpan {std::size_t list; int xBegin, xEnd;};
+	std::vector< std::vector<RowSpan> > rowsSpans(spec.height);
+	int firstRow = image.bottom()+1, lastRow = image.top()-1;
+	for(std::size_t i = 0; i < spansLists.size(); i++)
+		for(const PixelSpan &span : spansLists[i])
+		{
+			if(span.width() <= 0)
+				continue;
+			if(!image.contains(QRect(span.xBegin, span.row, span.width(), 1)))
+			{
+				std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] pixels are outside of the image...abort."<<std::endl;
+				return false;
+			}
+			RowSpan rowSpan = {i, span.xBegin, span.xEnd};
+			rowsSpans[span.row - spec.y].push_back(rowSpan);
+			firstRow	= std::min(firstRow, span.row);
+			lastRow		= std::max(lastRow, span.row);
+		}
+	if(firstRow > lastRow)
+		return false;
+
+	// float bands of full rows : scanlines by 64 rows, tiles by a row of tiles (read_tiles need tile aligned bounds or the image end)
+	const int			bandHeight	= spec.tile_width ? spec.tile_height : 64;
+	const int			bandBegin	= spec.tile_width ? spec.y + (firstRow - spec.y) / bandHeight * bandHeight : firstRow;
+	std::vector<float>	band		(std::size_t(spec.width) * nc * bandHeight);
+	std::vector<double>	sums		(spansLists.size() * 4, 0.0);
+	std::vector<std::size_t> counts	(spansLists.size(), 0);
+	bool isRead = !progress(0.0f);
+	for(int y = bandBegin; isRead && y <= lastRow; y += bandHeight)
+	{
+		int yEnd = std::min(y + bandHeight, image.bottom()+1);
+		isRead = spec.tile_width ? in->read_tiles(spec.x, spec.x + spec.width, y, yEnd, spec.z, spec.z+1, 0, nc, TypeDesc::FLOAT, band.data())
+			: in->read_scanlines(y, yEnd, spec.z, 0, nc, TypeDesc::FLOAT, band.data());
+		for(int row = y; isRead && row < yEnd; row++)
+			for(const RowSpan &rowSpan : rowsSpans[row - spec.y])
+			{
+				const float *pix	= band.data() + (std::size_t(row - y) * spec.width + (rowSpan.xBegin - spec.x)) * nc;
+				double		*sum	= &sums[4*rowSpan.list];
+				for(int x = rowSpan.xBegin; x < rowSpan.xEnd; x++, pix += nc)
+					for(int c = 0; c < nc; c++)
+						sum[c] += pix[c];
+				counts[rowSpan.list] += std::size_t(rowSpan.xEnd - rowSpan.xBegin);
+			}
+		isRead = isRead && !progress(float(yEnd - bandBegin) / (lastRow+1 - bandBegin));
+	}
+	if(!isRead)
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] cannot read bands (or cancelled): "<<in->geterror()<<std::endl;
+		return false;
+	}
+	in->close();
+
+	bool result = true;
+	averages.assign(spansLists.size() * 4, 0.0f);
+	for(std::size_t i = 0; i < spansLists.size(); i++)
+	{
+		if(counts[i] == 0)
+		{
+			result = false;
+			continue;
+		}
+		// same channels mapping as pixelView() : gray (+alpha) images give r=g=b, alpha is 1 when not stored
+		float channels[4] = {0.0f, 0.0f, 0.0f, 1.0f};
+		for(int c = 0; c < nc; c++)
+			channels[c] = float(sums[4*i + c] / counts[i]);
+		if(nc <= 2)
+		{
+			channels[3] = nc == 2 ? channels[1] : 1.0f;
+			channels[1] = channels[2] = channels[0];
+		}
+		std::copy(channels, channels + 4, &averages[4*i]);
+	}
+	return result;
+}
+
+//---------------------------------------------------------------------
+
 bool ImagePluginOIIO::save(QString filename)
 {
 	if(d->mImgBuf == nullptr)
@@ -441,54 +1442,1607 @@ bool ImagePluginOIIO::save(QString filename)
 
 bool ImagePluginOIIO::colorSpaceConversion()
 {
-	if(d->mImgBuf == nullptr)
+	if(!decode())
 	{
-		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] image not loaded...abort."<<std::endl;
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] image not decoded...abort."<<std::endl;
 		return false;
 	}
-	if(mColorSpace == "Linear"			|| 
-		mColorSpace == "sRGB"			||
-		mColorSpace == "GammaCorrected" ||
-		mColorSpace == "AdobeRGB"		||
-		mColorSpace == "Rec709"			|| 
-		mColorSpace == "KodakLog"		)
+	ColorTransfer::Space to = ColorTransfer::fromName(mColorSpace.toStdString());
+	if(to == ColorTransfer::Space::Unknown)
 	{
-		if(d->mImgBuf->spec().get_string_attribute("oiio:ColorSpace") != mColorSpace.toStdString())
-		{
-			std::shared_ptr<ImageBuf> ccSrc (d->mImgBuf); // color-corrected buffer
-			if (d->mImgBuf->spec().format != TypeDesc::FLOAT) 
-			{
-				// If the original src buffer isn't float, make a scratch space that is float.
-				ImageSpec floatSpec = d->mImgBuf->spec();
-				floatSpec.set_format (TypeDesc::FLOAT);
-				ccSrc.reset (new ImageBuf (floatSpec));
-			}
-			ccSrc->read(0,0,true,TypeDesc::FLOAT);
-			ImageBufAlgo::colorconvert(*ccSrc, *d->mImgBuf, "current", mColorSpace.toStdString() );
-			
-			if(ccSrc->has_error())
-				std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] color-corrected buffer error: "<<ccSrc->geterror()<<std::endl;
-			if(d->mImgBuf->has_error())
-				std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] mImgBuf buffer error: "<<d->mImgBuf->geterror()<<std::endl;
-			
-			std::swap(d->mImgBuf, ccSrc);
-
-			d->mImgBuf->write("imgBuf.CR2");
-			d->mImgBuf->write("imgBuf.png");
-			ccSrc->write("ccSrc.CR2");
-			ccSrc->write("ccSrc.png");
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] colorspace destination name ["<<mColorSpace.toStdString()<<"] is not handled"<<std::endl;
+		return false;
+	}
+	if(progress(0.0f))
+		return false;
 
-			return true;
-		}
-		else
+	// every variant is converted from the pristine decoded buffer (conversions never compound)
+	if(d->mState == LoadState::Decoded)
+	{
+		d->mDecodedBuf	= d->mImgBuf;
+		d->mDecodedQimg	= d->mQimg;
+	}
+	const ImageSpec		&spec		= d->mDecodedBuf->spec();
+	ColorTransfer		transfer	(ColorTransfer::fromName(spec.get_string_attribute("oiio:ColorSpace")), to);
+	if(transfer.isIdentity())
+	{
+		if(d->mState == LoadState::Decoded)
 		{
 			std::cout<<"["<<FILE_LINE_FUNC_STR<<"] no need colorspace conversion, current one is: ["<<mColorSpace.toStdString()<<"]"<<std::endl;
 			return false;
 		}
+		d->mImgBuf	= d->mDecodedBuf;
+		d->mQimg	= d->mDecodedQimg;
+		d->mState	= LoadState::Decoded;
+		progress(1.0f);
+		return true;
 	}
-	else
+
+	// already converted variant (and its QImage) : only a buffer swap
+	DecodedImageCache::Key key = d->variantKey(mColorSpace);
+	if(std::shared_ptr<const ColorSpaceVariant> variant = DecodedImageCache::instance().find<ColorSpaceVariant>(key))
 	{
-		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] colorspace destination name ["<<mColorSpace.toStdString()<<"] is not handled"<<std::endl;
+		d->mImgBuf		= variant->mBuf;
+		d->mQimg		= variant->mQimg;
+		d->mVariantKey	= key;
+		d->mState		= LoadState::Converted;
+		progress(1.0f);
+		return true;
+	}
+
+	// into a new float buffer (the decoded one may be shared with the decoded image caches or read-only mapped)
+	ImageSpec floatSpec = spec;
+	floatSpec.set_format(TypeDesc::FLOAT);
+	std::shared_ptr<ImageBuf> dstBuf(new ImageBuf(floatSpec));
+
+	// row bands converted in parallel through the ColorTransfer tables : integer buffers straight from their codes,
+	// others (half, ImageCache backed) read as float into the destination first and converted in place there.
+	// Progress is only reported from the calling thread
+	const int			nc				= spec.nchannels;
+	const int			nbColorChannels	= (spec.alpha_channel >= 0 && spec.alpha_channel < 3) ? spec.alpha_channel : std::min(nc, 3);
+	const std::size_t	rowValues		= std::size_t(spec.width) * nc;
+	const void			*srcPixels		= static_cast<const ImageBuf&>(*d->mDecodedBuf).localpixels();
+	float				*dstPixels		= static_cast<float*>(dstBuf->localpixels());
+	const int			bandHeight		= 64;
+	const int			nbBands			= (spec.height + bandHeight-1) / bandHeight;
+	const std::thread::id callerId		= std::this_thread::get_id();
+	std::atomic<bool>	isConverted		(dstPixels != nullptr);
+	std::atomic<bool>	isCancelled		(false);
+	std::atomic<int>	nbBandsDone		(0);
+	if(!isConverted)
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] cannot allocate the converted buffer."<<std::endl;
+		return false;
+	}
+	parallelFor(nbBands, 0, [&](int band)
+		{
+			if(isCancelled || !isConverted)
+				return;
+			if(std::this_thread::get_id() == callerId && progress(float(nbBandsDone) / nbBands))
+				isCancelled = true;
+			int			rowBegin	= band*bandHeight;
+			int			rowEnd		= std::min(rowBegin + bandHeight, spec.height);
+			std::size_t	offset		= std::size_t(rowBegin) * rowValues;
+			std::size_t	nbPixels	= std::size_t(rowEnd - rowBegin) * spec.width;
+			float		*dst		= dstPixels + offset;
+			switch(srcPixels ? spec.format.basetype : TypeDesc::UNKNOWN)
+			{
+			case TypeDesc::UINT8	: transfer.convert(static_cast<const std::uint8_t*>(srcPixels)	+ offset, dst, nbPixels, nc, nbColorChannels); break;
+			case TypeDesc::UINT16	: transfer.convert(static_cast<const std::uint16_t*>(srcPixels)	+ offset, dst, nbPixels, nc, nbColorChannels); break;
+			case TypeDesc::FLOAT	: transfer.convert(static_cast<const float*>(srcPixels)			+ offset, dst, nbPixels, nc, nbColorChannels); break;
+			default:
+				if(!d->getPixels(*d->mDecodedBuf, ROI(spec.x, spec.x + spec.width, spec.y + rowBegin, spec.y + rowEnd, spec.z, spec.z + 1, 0, nc), dst))
+				{
+					isConverted = false;
+					return;
+				}
+				transfer.convert(dst, dst, nbPixels, nc, nbColorChannels);
+				break;
+			}
+			nbBandsDone++;
+		}
+	);
+	if(isCancelled)
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] colorspace conversion cancelled."<<std::endl;
 		return false;
 	}
-}
\ No newline at end of file
+	if(!isConverted)
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] cannot read pixels: "<<d->mDecodedBuf->geterror()<<std::endl;
+		return false;
+	}
+	progress(1.0f);
+
+	dstBuf->specmod().attribute("oiio:ColorSpace", mColorSpace.toStdString());
+	d->mImgBuf		= dstBuf;
+	d->mQimg.reset();	// the QImage will be converted again from the new buffer (not from the file), then kept with the variant
+	d->mVariantKey	= key;
+	d->mState		= LoadState::Converted;
+	struct ColorSpaceVariant variant = {d->mImgBuf, d->mQimg};
+	DecodedImageCache::instance().insert(key, std::make_shared<const ColorSpaceVariant>(variant), floatSpec.image_bytes());
+	return true;
+}
+
+
+
+//---------------------------------------------------------------------
+//---------   ImagePluginOpenEXR  -------------------------------------
+//---------------------------------------------------------------------
+
+#include <ImfHeader.h>
+#include <ImfInputFile.h>
+#include <ImfOutputFile.h>
+#include <ImfChannelList.h>
+#include <ImfFrameBuffer.h>
+#include <ImfPreviewImage.h>
+#include <ImfStandardAttributes.h>
+#include <ImfThreading.h>
+#ifdef USE_OPENEXR_VERSION2
+#include <ImfMultiPartInputFile.h>
+#include <ImfInputPart.h>
+#include <ImfPartType.h>
+#endif
+#include <half.h>
+
+#include <set>
+
+namespace
+{
+	/// Imf decoding threads set once per process to the cores count (shared by all the opened files)
+	void initializeOpenEXRThreads()
+	{
+		static std::once_flag initialized;
+		std::call_once(initialized, []()
+			{
+				Imf::setGlobalThreadCount(int(std::max(1u, std::thread::hardware_concurrency())));
+			} );
+	}
+
+	/// stored channels of a layer : R,G,B(,A) or Y(,A)
+	struct ExrChannels
+	{
+		ExrChannels() : type(Imf::HALF)
+		{ channelIndex[0] = channelIndex[1] = channelIndex[2] = channelIndex[3] = -1; }
+
+		std::vector<std::string>	names;				///< full channel names in storage order
+		int							channelIndex[4];	///< storage index of the R,G,B,A channels (-1 if not stored)
+		Imf::PixelType				type;				///< HALF if every channel is HALF, FLOAT otherwise
+
+		std::size_t	channelSize() const {return type == Imf::HALF ? sizeof(half) : sizeof(float);}
+		std::size_t	pixelSize()	const {return names.size() * channelSize();}
+
+		/// false if the layer has neither R,G,B nor Y full resolution channels
+		bool select(const Imf::Header &header, const std::string &layer)
+		{
+			*this = ExrChannels();
+			const std::string		prefix	= layer.empty() ? std::string() : layer + ".";
+			const Imf::ChannelList	&list	= header.channels();
+			auto has = [&](const char *name)
+				{
+					const Imf::Channel *channel = list.findChannel((prefix + name).c_str());
+					return channel != nullptr && channel->xSampling == 1 && channel->ySampling == 1;
+				};
+			if(has("R") && has("G") && has("B"))
+			{
+				names = {prefix + "R", prefix + "G", prefix + "B"};
+				channelIndex[0] = 0; channelIndex[1] = 1; channelIndex[2] = 2;
+			}
+			else if(has("Y"))
+			{
+				names = {prefix + "Y"};
+				channelIndex[0] = channelIndex[1] = channelIndex[2] = 0;
+			}
+			else
+				return false;
+			if(has("A"))
+			{
+				channelIndex[3] = int(names.size());
+				names.push_back(prefix + "A");
+			}
+			for(const std::string &name : names)
+				if(list.findChannel(name.c_str())->type != Imf::HALF)
+					type = Imf::FLOAT;
+			return true;
+		}
+	};
+
+	/// part of a file holding a layer (the file itself before OpenEXR 2), Imf exceptions are not caught
+	class ExrReader
+	{
+	public:
+		ExrReader(const std::string &filename, const std::string &layer) : mHeader(nullptr), mIsValid(false)
+		{
+#ifdef USE_OPENEXR_VERSION2
+			// first part holding the layer (deep parts can't be read as flat pixels), the pixels reader is only opened on it
+			mFile.reset(new Imf::MultiPartInputFile(filename.c_str()));
+			int part = 0;
+			for(; part < mFile->parts() && !mIsValid; part++)
+			{
+				const Imf::Header &header = mFile->header(part);
+				if(!(header.hasType() && Imf::isDeepData(header.type())))
+					mIsValid = mChannels.select(header, layer);
+			}
+			mHeader = &mFile->header(mIsValid ? part-1 : 0);
+			if(mIsValid)
+				mInput.reset(new Imf::InputPart(*mFile, part-1));
+#else
+			mInput.reset(new Imf::InputFile(filename.c_str()));
+			mHeader		= &mInput->header();
+			mIsValid	= mChannels.select(*mHeader, layer);
+#endif
+		}
+
+		/// the layer was found (otherwise the pixels can't be read, header() is the first part one)
+		bool				isValid()	const {return mIsValid;}
+		const ExrChannels&	channels()	const {return mChannels;}
+		const Imf::Header&	header()	const {return *mHeader;}
+		QSize				size()		const
+		{
+			const Imath::Box2i &dataWindow = header().dataWindow();
+			return QSize(dataWindow.max.x - dataWindow.min.x + 1, dataWindow.max.y - dataWindow.min.y + 1);
+		}
+
+		/// all the headers of the file
+		std::vector<const Imf::Header*> headers() const
+		{
+			std::vector<const Imf::Header*> list;
+#ifdef USE_OPENEXR_VERSION2
+			for(int part = 0; part < mFile->parts(); part++)
+				list.push_back(&mFile->header(part));
+#else
+			list.push_back(mHeader);
+#endif
+			return list;
+		}
+
+		/// slices of the stored channels (interleaved) : pixel x,y of the data window is at base + x*pixelSize + y*rowStride
+		void setFrameBuffer(char *base, std::size_t rowStride)
+		{
+			const Imath::Box2i &dataWindow = header().dataWindow();
+			const std::size_t	pixelSize	= mChannels.pixelSize();
+			char				*origin		= base - std::ptrdiff_t(dataWindow.min.x) * std::ptrdiff_t(pixelSize) - std::ptrdiff_t(dataWindow.min.y) * std::ptrdiff_t(rowStride);
+			Imf::FrameBuffer	frameBuffer;
+			for(std::size_t c = 0; c < mChannels.names.size(); c++)
+				frameBuffer.insert(mChannels.names[c], Imf::Slice(mChannels.type, origin + c * mChannels.channelSize(), pixelSize, rowStride));
+			mInput->setFrameBuffer(frameBuffer);
+		}
+
+		/// rows of the data window [y0, y1] (decoded by the Imf threads)
+		void readPixels(int y0, int y1)
+		{
+			const int yMin = header().dataWindow().min.y;
+			mInput->readPixels(yMin + y0, yMin + y1);
+		}
+
+	private:
+#ifdef USE_OPENEXR_VERSION2
+		std::unique_ptr<Imf::MultiPartInputFile>	mFile;
+		std::unique_ptr<Imf::InputPart>				mInput;
+#else
+		std::unique_ptr<Imf::InputFile>				mInput;
+#endif
+		const Imf::Header*	mHeader;
+		bool				mIsValid;
+		ExrChannels			mChannels;
+	};
+
+	/// channel value of an interleaved pixel
+	float exrValue(const unsigned char *pix, Imf::PixelType type, int index)
+	{
+		return type == Imf::HALF ? float(reinterpret_cast<const half*>(pix)[index]) : reinterpret_cast<const float*>(pix)[index];
+	}
+}
+
+class ImagePluginOpenEXR::Private
+{
+public:
+	Private() : mState(LoadState::Unopened)
+	{}
+
+	/// RGBA of a stored pixel (missing channels are 0, or 1 for alpha)
+	void rgba(const unsigned char *pix, float values[4]) const
+	{
+		for(int c = 0; c < 4; c++)
+			values[c] = mChannels.channelIndex[c] >= 0 ? exrValue(pix, mChannels.type, mChannels.channelIndex[c]) : (c == 3 ? 1.0f : 0.0f);
+	}
+
+public:
+	std::string					mFileName;
+	std::string					mLayer;		///< layer read at next loadImage()
+	std::string					mLoadedLayer;
+	LoadState					mState;
+	QSize						mSize;		///< data window size
+	ExrChannels					mChannels;	///< of the loaded layer
+	std::vector<unsigned char>	mPixels;	///< interleaved stored channels, data window rows
+};
+
+//---------------------------------------------------------------------
+
+ImagePluginOpenEXR::ImagePluginOpenEXR()
+	: ImagePlugin()
+	, d(new Private)
+{
+	initializeOpenEXRThreads();
+}
+
+ImagePluginOpenEXR::~ImagePluginOpenEXR()
+{
+	delete d;
+}
+
+//---------------------------------------------------------------------
+
+void ImagePluginOpenEXR::setLayer(const QString &layer)
+{
+	d->mLayer = layer.toStdString();
+}
+
+QString ImagePluginOpenEXR::layer() const
+{
+	return QString::fromStdString(d->mLayer);
+}
+
+QStringList ImagePluginOpenEXR::layers() const
+{
+	QStringList layers;
+	if(d->mState == LoadState::Unopened)
+		return layers;
+	try
+	{
+		ExrReader reader(d->mFileName, d->mLoadedLayer);
+		for(const Imf::Header *header : reader.headers())
+		{
+			std::set<std::string> names;
+			header->channels().layers(names);
+			names.insert(std::string());
+			ExrChannels channels;
+			for(const std::string &name : names)
+				if(channels.select(*header, name) && !layers.contains(QString::fromStdString(name)))
+					layers.append(QString::fromStdString(name));
+		}
+	}
+	catch(const std::exception &e)
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] cannot read "<<d->mFileName<<": "<<e.what()<<std::endl;
+	}
+	return layers;
+}
+
+//---------------------------------------------------------------------
+
+QString ImagePluginOpenEXR::getImageFilterExtensions()
+{
+	// format: 'Image (*.png *.jpg *.bmp)')
+	return QString("OpenEXR image (*.exr *.sxr *.mxr)");
+}
+
+//---------------------------------------------------------------------
+
+ImagePlugin::ImageInfo ImagePluginOpenEXR::probe(QString filename) const
+{
+	ImageInfo info;
+	try
+	{
+		ExrReader			reader(filename.toStdString(), d->mLayer);
+		const Imf::Header	&header = reader.header();
+		info.width		= reader.size().width();
+		info.height		= reader.size().height();
+		if(reader.isValid())
+		{
+			info.nbChannels	= int(reader.channels().names.size());
+			info.bitDepth	= reader.channels().type == Imf::HALF ? 16 : 32;
+		}
+		info.colorSpace	= "Linear";
+		if(Imf::hasExpTime(header))		info.exposureTime	= Imf::expTime(header);
+		if(Imf::hasAperture(header))	info.fNumber		= Imf::aperture(header);
+		if(Imf::hasIsoSpeed(header))	info.isoSpeed		= int(Imf::isoSpeed(header));
+	}
+	catch(const std::exception &e)
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] cannot read "<<filename.toStdString()<<": "<<e.what()<<std::endl;
+	}
+	return info;
+}
+
+//---------------------------------------------------------------------
+
+bool ImagePluginOpenEXR::loadImage(QString filename)
+{
+	std::vector<unsigned char>().swap(d->mPixels);
+	d->mFileName	= filename.toStdString();
+	d->mLoadedLayer	= d->mLayer;
+	d->mSize		= QSize();
+	d->mState		= LoadState::Unopened;
+	try
+	{
+		// headers only : the pixels are read by decode()
+		ExrReader reader(d->mFileName, d->mLoadedLayer);
+		if(!reader.isValid())
+		{
+			std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] no R,G,B or Y channels in the layer '"<<d->mLoadedLayer<<"' of "<<d->mFileName<<"...abort."<<std::endl;
+			return false;
+		}
+		d->mChannels	= reader.channels();
+		d->mSize		= reader.size();
+	}
+	catch(const std::exception &e)
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] cannot read "<<d->mFileName<<": "<<e.what()<<std::endl;
+		return false;
+	}
+	d->mState = LoadState::HeaderOnly;
+	return true;
+}
+
+//---------------------------------------------------------------------
+
+bool ImagePluginOpenEXR::decode()
+{
+	if(isDecoded())
+		return true;
+	if(d->mState != LoadState::HeaderOnly)
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] image not loaded...abort."<<std::endl;
+		return false;
+	}
+	try
+	{
+		ExrReader	reader(d->mFileName, d->mLoadedLayer);
+		if(!reader.isValid())
+		{
+			std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] no R,G,B or Y channels in the layer '"<<d->mLoadedLayer<<"' of "<<d->mFileName<<"...abort."<<std::endl;
+			return false;
+		}
+		const int	width		= reader.size().width();
+		const int	height		= reader.size().height();
+		std::size_t	rowStride	= reader.channels().pixelSize() * std::size_t(width);
+		std::vector<unsigned char> pixels(rowStride * std::size_t(height));
+		reader.setFrameBuffer(reinterpret_cast<char*>(pixels.data()), rowStride);
+
+		// bands of scanlines : enough chunks per band to keep the Imf threads busy, progress and cancel between the bands
+		const int bandHeight = std::max(64, 32 * Imf::globalThreadCount());
+		for(int y = 0; y < height; y += bandHeight)
+		{
+			if(progress(float(y) / height))
+				return false;
+			reader.readPixels(y, std::min(y + bandHeight, height) - 1);
+		}
+		d->mPixels.swap(pixels);
+	}
+	catch(const std::exception &e)
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] cannot decode "<<d->mFileName<<": "<<e.what()<<std::endl;
+		return false;
+	}
+	d->mState = LoadState::Decoded;
+	progress(1.0f);
+	return true;
+}
+
+QRect ImagePluginOpenEXR::decodedRegion() const
+{
+	return isDecoded() ? QRect(QPoint(0, 0), d->mSize) : QRect();
+}
+
+ImagePlugin::LoadState ImagePluginOpenEXR::loadState() const
+{
+	return d->mState;
+}
+
+ImagePlugin::PixelType ImagePluginOpenEXR::decodedType() const
+{
+	return pixelView().type;
+}
+
+//---------------------------------------------------------------------
+
+QImage ImagePluginOpenEXR::toQImage()
+{
+	if(!decode())
+		return QImage();
+
+	// display only : linear to sRGB, clamped to 8 bits
+	const ColorTransfer	toSRGB(ColorTransfer::Space::Linear, ColorTransfer::Space::sRGB);
+	const PixelView		view = pixelView();
+	QImage				qimg(d->mSize, QImage::Format_RGBA8888);
+	for(int y = 0; y < qimg.height(); y++)
+	{
+		const unsigned char	*pix	= view.scanLine(y);
+		uchar				*line	= qimg.scanLine(y);
+		for(int x = 0; x < qimg.width(); x++, pix += view.pixelStride, line += 4)
+		{
+			float rgba[4];
+			d->rgba(pix, rgba);
+			for(int c = 0; c < 3; c++)
+				line[c] = Float8BitLUT::instance()(toSRGB(rgba[c]));
+			line[3] = Float8BitLUT::instance()(rgba[3]);
+		}
+		if((y & 63) == 0 && progress(float(y) / qimg.height()))
+			return QImage();
+	}
+	progress(1.0f);
+	return qimg;
+}
+
+//---------------------------------------------------------------------
+
+QImage ImagePluginOpenEXR::preview(const QSize &maxSize) const
+{
+	// an other reader : it can run while an other thread decode the image
+	if(d->mFileName.empty())
+		return QImage();
+	try
+	{
+		ExrReader reader(d->mFileName, d->mLoadedLayer);
+
+		// the preview stored by the writer if any (already 8 bits, gamma encoded)
+		if(reader.header().hasPreviewImage())
+		{
+			const Imf::PreviewImage &stored = reader.header().previewImage();
+			QImage img(int(stored.width()), int(stored.height()), QImage::Format_RGBA8888);
+			for(int y = 0; y < img.height(); y++)
+			{
+				uchar *line = img.scanLine(y);
+				for(int x = 0; x < img.width(); x++, line += 4)
+				{
+					const Imf::PreviewRgba &pix = stored.pixel(unsigned(x), unsigned(y));
+					line[0] = pix.r; line[1] = pix.g; line[2] = pix.b; line[3] = pix.a;
+				}
+			}
+			return img.width() > maxSize.width() || img.height() > maxSize.height() ? img.scaled(maxSize, Qt::KeepAspectRatio, Qt::SmoothTransformation) : img;
+		}
+		if(!reader.isValid())
+			return QImage();
+
+		// otherwise only the scanlines of the preview rows are read (one row buffer : rows stride 0), then subsampled
+		const QSize			size		= reader.size();
+		const QSize			previewSize	= size.width() > maxSize.width() || size.height() > maxSize.height() ? size.scaled(maxSize, Qt::KeepAspectRatio) : size;
+		const std::size_t	pixelSize	= reader.channels().pixelSize();
+		std::vector<unsigned char> row(pixelSize * std::size_t(size.width()));
+		reader.setFrameBuffer(reinterpret_cast<char*>(row.data()), 0);
+
+		const ColorTransfer	toSRGB(ColorTransfer::Space::Linear, ColorTransfer::Space::sRGB);
+		QImage				img(previewSize, QImage::Format_RGBA8888);
+		for(int y = 0; y < img.height(); y++)
+		{
+			int fileRow = int(std::int64_t(y) * size.height() / img.height());
+			reader.readPixels(fileRow, fileRow);
+			uchar *line = img.scanLine(y);
+			for(int x = 0; x < img.width(); x++, line += 4)
+			{
+				const unsigned char *pix = row.data() + std::size_t(std::int64_t(x) * size.width() / img.width()) * pixelSize;
+				float rgba[4];
+				for(int c = 0; c < 4; c++)
+					rgba[c] = reader.channels().channelIndex[c] >= 0 ? exrValue(pix, reader.channels().type, reader.channels().channelIndex[c]) : 1.0f;
+				for(int c = 0; c < 3; c++)
+					line[c] = Float8BitLUT::instance()(toSRGB(rgba[c]));
+				line[3] = Float8BitLUT::instance()(rgba[3]);
+			}
+		}
+		return img;
+	}
+	catch(const std::exception &e)
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] cannot read "<<d->mFileName<<": "<<e.what()<<std::endl;
+	}
+	return QImage();
+}
+
+//---------------------------------------------------------------------
+
+QSize ImagePluginOpenEXR::size() const
+{
+	// known from the header
+	return d->mState != LoadState::Unopened ? d->mSize : QSize();
+}
+
+//---------------------------------------------------------------------
+
+float ImagePluginOpenEXR::readSinglePixelChannel(int x, int y, int channel) const
+{
+	float rgba[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+	if(channel < 0 || channel > 3 || !readRegion(QRect(x, y, 1, 1), rgba, 4))
+		return 0.0f;
+	return rgba[channel];
+}
+
+//---------------------------------------------------------------------
+
+bool ImagePluginOpenEXR::readRegion(const QRect &region, float *pixels, int nbChannels) const
+{
+	if(!isDecoded())
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"]Cannot continue without a decoded image."<<std::endl;
+		return false;
+	}
+	if(!decodedRegion().contains(region) || pixels == nullptr || nbChannels < 1)
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] region is outside the image or output buffer is invalid...abort."<<std::endl;
+		return false;
+	}
+	const PixelView view = pixelView();
+	float *out = pixels;
+	for(int row = region.top(); row <= region.bottom(); row++)
+	{
+		const unsigned char *pix = view.pixel(region.left(), row);
+		for(int col = region.left(); col <= region.right(); col++, pix += view.pixelStride)
+		{
+			float rgba[4];
+			d->rgba(pix, rgba);
+			for(int c = 0; c < nbChannels; c++)
+				*out++ = c < 4 ? rgba[c] : 0.0f;
+		}
+	}
+	return true;
+}
+
+//---------------------------------------------------------------------
+
+ImagePlugin::PixelView ImagePluginOpenEXR::pixelView() const
+{
+	PixelView view;
+	if(!isDecoded())
+		return view;
+	view.data			= d->mPixels.data();
+	view.type			= d->mChannels.type == Imf::HALF ? PixelType::HALF : PixelType::FLOAT;
+	view.rect			= decodedRegion();
+	view.nbChannels		= int(d->mChannels.names.size());
+	for(int c = 0; c < 4; c++)
+		view.channelIndex[c] = d->mChannels.channelIndex[c];
+	view.pixelStride	= std::ptrdiff_t(d->mChannels.pixelSize());
+	view.rowStride		= view.pixelStride * d->mSize.width();
+	return view;
+}
+
+//---------------------------------------------------------------------
+
+bool ImagePluginOpenEXR::averagesChannels(const pixelsCoords &pixCoords, float &r, float &g, float &b, float &a) const
+{
+	return averagesChannels(makePixelSpans(pixCoords), r, g, b, a);
+}
+
+//---------------------------------------------------------------------
+
+bool ImagePluginOpenEXR::averagesChannels(const pixelSpans &spans, float &r, float &g, float &b, float &a) const
+{
+	if(!isDecoded())
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"]Cannot continue without a decoded image."<<std::endl;
+		return false;
+	}
+
+	// the half channels are expanded in registers by the kernels (no float copy of the image)
+	if(averagesChannelsFromView(pixelView(), spans, r, g, b, a))
+		return true;
+
+	std::cout<<"["<<FILE_LINE_FUNC_STR<<"] ERROR occured. Some invalid pixel was detected...abort."<<std::endl;
+	return false;
+}
+
+//---------------------------------------------------------------------
+
+bool ImagePluginOpenEXR::save(QString filename)
+{
+	if(!decode())
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"]Cannot continue without a decoded image."<<std::endl;
+		return false;
+	}
+	std::cout<<"Saving OpenEXR image: "<<filename.toStdString()<<std::flush;
+
+	// an EXR of the measured channels (without their layer prefix), other formats through the display QImage
+	bool ok = false;
+	if(filename.endsWith(".exr", Qt::CaseInsensitive))
+	{
+		try
+		{
+			const std::size_t	prefixSize = d->mLoadedLayer.empty() ? 0 : d->mLoadedLayer.size() + 1;
+			const std::size_t	pixelSize	= d->mChannels.pixelSize();
+			const std::size_t	rowStride	= pixelSize * std::size_t(d->mSize.width());
+			Imf::Header			header(d->mSize.width(), d->mSize.height());
+			Imf::FrameBuffer	frameBuffer;
+			char				*base = reinterpret_cast<char*>(d->mPixels.data());
+			for(std::size_t c = 0; c < d->mChannels.names.size(); c++)
+			{
+				std::string name = d->mChannels.names[c].substr(prefixSize);
+				header.channels().insert(name, Imf::Channel(d->mChannels.type));
+				frameBuffer.insert(name, Imf::Slice(d->mChannels.type, base + c * d->mChannels.channelSize(), pixelSize, rowStride));
+			}
+			Imf::OutputFile file(filename.toStdString().c_str(), header);
+			file.setFrameBuffer(frameBuffer);
+			file.writePixels(d->mSize.height());
+			ok = true;
+		}
+		catch(const std::exception &e)
+		{
+			std::cerr<<std::endl<<"["<<FILE_LINE_FUNC_STR<<"] "<<e.what();
+		}
+	}
+	else
+		ok = toQImage().save(filename);
+	std::cout<<(ok?" ...Done":"...FAILED")<<std::endl;
+	return ok;
+}
+
+
+
+
+//---------------------------------------------------------------------
+//---------   ImagePluginLibRaw  --------------------------------------
+//---------------------------------------------------------------------
+
+#ifdef USE_LIBRAW
+
+#include <libraw/libraw.h>
+
+namespace
+{
+	/// LibRaw progress handler forwarding to the ProgressCallback given as opaque data (non zero cancel the operation)
+	int libRawProgress(void *callback, enum LibRaw_progress stage, int iteration, int expected)
+	{
+		const ImagePlugin::ProgressCallback &progressCallback = *static_cast<const ImagePlugin::ProgressCallback*>(callback);
+		return progressCallback && expected > 0 && progressCallback(float(iteration) / float(expected)) ? 1 : 0;
+	}
+}
+
+class ImagePluginLibRaw::Private
+{
+public:
+	Private() : mRaw(new LibRaw), mState(LoadState::Unopened), mMosaic(nullptr), mRowStride(0), mWhite(0.0f)
+	{
+		mSite[0][0] = mSite[0][1] = mSite[1][0] = mSite[1][1] = 0;
+		mBlack[0] = mBlack[1] = mBlack[2] = mBlack[3] = 0.0f;
+	}
+
+	/// sites of the visible area 2x2 pattern from the LibRaw filters, false if it is not a RGB Bayer pattern
+	bool	setupCFA();
+
+	QSize	size() const {return QSize(mRaw->imgdata.sizes.width, mRaw->imgdata.sizes.height);}
+
+	const ushort*	row(int y) const		{return mMosaic + std::ptrdiff_t(y) * mRowStride;}
+	int				site(int x, int y) const	{return mSite[y & 1][x & 1];}
+
+	/// normalized value of a mosaic pixel (black subtracted, divided by the white level)
+	float	value(int x, int y) const
+	{
+		int s = site(x, y);
+		return (row(y)[x] - mBlack[s]) / (mWhite - mBlack[s]);
+	}
+
+	/// R,G,B of the 2x2 quad holding x,y (greens averaged)
+	void	quadRGB(int x, int y, float rgb[3]) const
+	{
+		int x0 = std::min(x & ~1, size().width() - 2);
+		int y0 = std::min(y & ~1, size().height() - 2);
+		float sites[4];
+		for(int qy = y0; qy < y0 + 2; qy++)
+			for(int qx = x0; qx < x0 + 2; qx++)
+				sites[site(qx, qy)] = value(qx, qy);
+		rgb[0] = sites[int(CFASite::R)];
+		rgb[1] = 0.5f * (sites[int(CFASite::G1)] + sites[int(CFASite::G2)]);
+		rgb[2] = sites[int(CFASite::B)];
+	}
+
+public:
+	QString					mFileName;
+	std::unique_ptr<LibRaw>	mRaw;		///< hold the unpacked mosaic once decoded
+	LoadState				mState;
+	const ushort*			mMosaic;	///< first visible pixel of the raw image (inside mRaw)
+	std::ptrdiff_t			mRowStride;	///< in pixels
+	int						mSite[2][2];	///< CFASite of the pattern pixels [row parity][col parity]
+	float					mBlack[4];	///< per CFASite (ADU)
+	float					mWhite;		///< ADU
+};
+
+//---------------------------------------------------------------------
+
+bool ImagePluginLibRaw::Private::setupCFA()
+{
+	const libraw_iparams_t	&idata	= mRaw->imgdata.idata;
+	const libraw_colordata_t &color	= mRaw->imgdata.color;
+	if(idata.filters < 1000 || idata.colors != 3) // X-Trans (or 1 color) sensors, Foveon and linear DNG (no filters)
+		return false;
+
+	// the filters can describe up to 8x2 patterns : only a 2x2 repetition is measured by site
+	for(int y = 0; y < 8; y++)
+		for(int x = 0; x < 2; x++)
+			if(mRaw->COLOR(y, x) != mRaw->COLOR(y & 1, x & 1))
+				return false;
+
+	int redRow = -1, nbR = 0, nbG = 0, nbB = 0;
+	for(int y = 0; y < 2; y++)
+		for(int x = 0; x < 2; x++)
+			switch(idata.cdesc[mRaw->COLOR(y, x)])
+			{
+			case 'R': redRow = y;	nbR++; break;
+			case 'G':				nbG++; break;
+			case 'B':				nbB++; break;
+			default: return false;
+			}
+	if(nbR != 1 || nbG != 2 || nbB != 1)
+		return false;
+
+	for(int y = 0; y < 2; y++)
+		for(int x = 0; x < 2; x++)
+		{
+			int colorIndex = mRaw->COLOR(y, x);
+			switch(idata.cdesc[colorIndex])
+			{
+			case 'R': mSite[y][x] = int(CFASite::R); break;
+			case 'B': mSite[y][x] = int(CFASite::B); break;
+			default	: mSite[y][x] = int(y == redRow ? CFASite::G1 : CFASite::G2); break;
+			}
+
+			// global black + per color black + black pattern (only exact when it repeats along the 2x2 pattern)
+			float black = float(color.black + color.cblack[colorIndex]);
+			if(color.cblack[4] > 0 && color.cblack[5] > 0)
+			{
+				if(2 % color.cblack[4] != 0 || 2 % color.cblack[5] != 0)
+					std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] black pattern "<<color.cblack[4]<<"x"<<color.cblack[5]<<" larger than the CFA pattern : ignored."<<std::endl;
+				else
+					black += float(color.cblack[6 + (y % color.cblack[4]) * color.cblack[5] + x % color.cblack[5]]);
+			}
+			mBlack[mSite[y][x]] = black;
+		}
+	mWhite = float(color.maximum);
+	return mWhite > *std::max_element(mBlack, mBlack + 4);
+}
+
+//---------------------------------------------------------------------
+
+ImagePluginLibRaw::ImagePluginLibRaw()
+	: ImagePlugin()
+	, d(new Private)
+{
+
+}
+
+ImagePluginLibRaw::~ImagePluginLibRaw()
+{
+	delete d;
+}
+
+//---------------------------------------------------------------------
+
+QString ImagePluginLibRaw::getImageFilterExtensions()
+{
+	// format: 'Image (*.png *.jpg *.bmp)')
+	return QString("Raw image (*.cr2 *.cr3 *.crw *.nef *.nrw *.arw *.srf *.sr2 *.dng *.orf *.rw2 *.raf *.pef *.srw *.3fr *.erf *.kdc *.mrw *.x3f)");
+}
+
+//---------------------------------------------------------------------
+
+ImagePlugin::ImageInfo ImagePluginLibRaw::probe(QString filename) const
+{
+	// an other LibRaw instance : the opened image is not changed
+	ImageInfo				info;
+	std::unique_ptr<LibRaw>	raw(new LibRaw);
+	int ret = raw->open_file(filename.toLocal8Bit().constData());
+	if(ret != LIBRAW_SUCCESS)
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] cannot read "<<filename.toStdString()<<": "<<libraw_strerror(ret)<<std::endl;
+		return info;
+	}
+	info.width		= raw->imgdata.sizes.width;
+	info.height		= raw->imgdata.sizes.height;
+	info.nbChannels	= 1;	// the mosaic
+	while(info.bitDepth < 16 && (1u << info.bitDepth) <= raw->imgdata.color.maximum)
+		info.bitDepth++;
+	info.exposureTime	= raw->imgdata.other.shutter;
+	info.fNumber		= raw->imgdata.other.aperture;
+	info.isoSpeed		= int(raw->imgdata.other.iso_speed);
+	return info;
+}
+
+//---------------------------------------------------------------------
+
+bool ImagePluginLibRaw::loadImage(QString filename)
+{
+	d->mRaw->recycle();
+	d->mMosaic		= nullptr;
+	d->mFileName	= filename;
+	d->mState		= LoadState::Unopened;
+
+	// open_file only parse the metadata, the raw data are read by unpack() (see decode())
+	int ret = d->mRaw->open_file(filename.toLocal8Bit().constData());
+	if(ret != LIBRAW_SUCCESS)
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] cannot read "<<filename.toStdString()<<": "<<libraw_strerror(ret)<<std::endl;
+		return false;
+	}
+	d->mState = LoadState::HeaderOnly;
+	return true;
+}
+
+//---------------------------------------------------------------------
+
+bool ImagePluginLibRaw::decode()
+{
+	if(isDecoded())
+		return true;
+	if(d->mState != LoadState::HeaderOnly)
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] image not loaded...abort."<<std::endl;
+		return false;
+	}
+	if(progress(0.0f))
+		return false;
+
+	d->mRaw->set_progress_handler(libRawProgress, &mProgressCallback);
+	int ret = d->mRaw->unpack();
+	d->mRaw->set_progress_handler(nullptr, nullptr);
+	if(ret != LIBRAW_SUCCESS)
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] cannot unpack "<<d->mFileName.toStdString()<<": "<<libraw_strerror(ret)<<std::endl;
+		return false;
+	}
+	const libraw_rawdata_t	&rawdata	= d->mRaw->imgdata.rawdata;
+	const libraw_image_sizes_t &sizes	= d->mRaw->imgdata.sizes;
+	if(rawdata.raw_image == nullptr || !d->setupCFA())
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] "<<d->mFileName.toStdString()<<" is not a RGB Bayer mosaic (only 2x2 Bayer patterns are measured)...abort."<<std::endl;
+		return false;
+	}
+	d->mRowStride	= std::ptrdiff_t(sizes.raw_pitch / sizeof(ushort));
+	d->mMosaic		= rawdata.raw_image + sizes.top_margin * d->mRowStride + sizes.left_margin;
+	d->mState		= LoadState::Decoded;
+
+	std::cout<<"LibRaw mosaic "<<sizes.width<<"x"<<sizes.height<<" black (R,G1,G2,B) = "
+		<<d->mBlack[0]<<","<<d->mBlack[1]<<","<<d->mBlack[2]<<","<<d->mBlack[3]<<" white = "<<d->mWhite<<std::endl;
+	progress(1.0f);
+	return true;
+}
+
+QRect ImagePluginLibRaw::decodedRegion() const
+{
+	return isDecoded() ? QRect(QPoint(0, 0), d->size()) : QRect();
+}
+
+ImagePlugin::LoadState ImagePluginLibRaw::loadState() const
+{
+	return d->mState;
+}
+
+ImagePlugin::PixelType ImagePluginLibRaw::decodedType() const
+{
+	return isDecoded() ? PixelType::UINT16 : PixelType::UNKNOWN;
+}
+
+//---------------------------------------------------------------------
+
+float ImagePluginLibRaw::blackLevel(CFASite site) const
+{
+	return isDecoded() ? d->mBlack[int(site)] : 0.0f;
+}
+
+float ImagePluginLibRaw::whiteLevel() const
+{
+	return isDecoded() ? d->mWhite : 0.0f;
+}
+
+ImagePlugin::PixelView ImagePluginLibRaw::mosaicView() const
+{
+	PixelView view;
+	if(!isDecoded())
+		return view;
+	view.data			= reinterpret_cast<const unsigned char*>(d->mMosaic);
+	view.type			= PixelType::UINT16;
+	view.rect			= decodedRegion();
+	view.nbChannels		= 1;
+	view.channelIndex[0] = view.channelIndex[1] = view.channelIndex[2] = 0;
+	view.pixelStride	= sizeof(ushort);
+	view.rowStride		= d->mRowStride * std::ptrdiff_t(sizeof(ushort));
+	return view;
+}
+
+ImagePluginLibRaw::CFASite ImagePluginLibRaw::cfaSite(int x, int y) const
+{
+	return CFASite(d->site(x, y));
+}
+
+//---------------------------------------------------------------------
+
+QImage ImagePluginLibRaw::toQImage()
+{
+	if(!decode())
+		return QImage();
+
+	// display only : 2x2 quads to sRGB (no white balance)
+	const ColorTransfer	toSRGB(ColorTransfer::Space::Linear, ColorTransfer::Space::sRGB);
+	const QSize			imgSize = d->size();
+	QImage				qimg(imgSize, QImage::Format_RGB32);
+	for(int y = 0; y < imgSize.height(); y++)
+	{
+		QRgb *line = reinterpret_cast<QRgb*>(qimg.scanLine(y));
+		for(int x = 0; x < imgSize.width(); x++)
+		{
+			float rgb[3];
+			d->quadRGB(x, y, rgb);
+			line[x] = qRgb(Float8BitLUT::instance()(toSRGB(rgb[0])), Float8BitLUT::instance()(toSRGB(rgb[1])), Float8BitLUT::instance()(toSRGB(rgb[2])));
+		}
+		if((y & 63) == 0 && progress(float(y) / imgSize.height()))
+			return QImage();
+	}
+	progress(1.0f);
+	return qimg;
+}
+
+//---------------------------------------------------------------------
+
+QImage ImagePluginLibRaw::preview(const QSize &maxSize) const
+{
+	// the embedded thumbnail, read by an other LibRaw instance : it can run while an other thread unpack the image
+	if(d->mFileName.isEmpty())
+		return QImage();
+	std::unique_ptr<LibRaw> raw(new LibRaw);
+	if(raw->open_file(d->mFileName.toLocal8Bit().constData()) != LIBRAW_SUCCESS || raw->unpack_thumb() != LIBRAW_SUCCESS)
+		return QImage();
+
+	int ret = LIBRAW_SUCCESS;
+	libraw_processed_image_t *thumb = raw->dcraw_make_mem_thumb(&ret);
+	if(thumb == nullptr)
+		return QImage();
+	QImage img;
+	if(thumb->type == LIBRAW_IMAGE_JPEG)
+		img = QImage::fromData(thumb->data, int(thumb->data_size), "JPG");
+	else if(thumb->type == LIBRAW_IMAGE_BITMAP && thumb->colors == 3 && thumb->bits == 8)
+		img = QImage(thumb->data, thumb->width, thumb->height, thumb->width * 3, QImage::Format_RGB888).copy();
+	LibRaw::dcraw_clear_mem(thumb);
+
+	if(!img.isNull() && (img.width() > maxSize.width() || img.height() > maxSize.height()))
+		img = img.scaled(maxSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+	return img;
+}
+
+//---------------------------------------------------------------------
+
+QSize ImagePluginLibRaw::size() const
+{
+	// known from the metadata
+	return d->mState != LoadState::Unopened ? d->size() : QSize();
+}
+
+//---------------------------------------------------------------------
+
+float ImagePluginLibRaw::readSinglePixelChannel(int x, int y, int channel) const
+{
+	if(!isDecoded())
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"]Cannot continue without a decoded mosaic."<<std::endl;
+		return 0.0f;
+	}
+	if(!decodedRegion().contains(x, y) || channel < 0 || channel > 3)
+		return 0.0f;
+	if(channel == 3)
+		return 1.0f;
+	float rgb[3];
+	d->quadRGB(x, y, rgb);
+	return rgb[channel];
+}
+
+//---------------------------------------------------------------------
+
+bool ImagePluginLibRaw::readRegion(const QRect &region, float *pixels, int nbChannels) const
+{
+	if(!isDecoded())
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"]Cannot continue without a decoded mosaic."<<std::endl;
+		return false;
+	}
+	if(!decodedRegion().contains(region) || pixels == nullptr || nbChannels < 1)
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] region is outside the image or output buffer is invalid...abort."<<std::endl;
+		return false;
+	}
+	float *out = pixels;
+	for(int row = region.top(); row <= region.bottom(); row++)
+		for(int col = region.left(); col <= region.right(); col++)
+		{
+			float rgba[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+			d->quadRGB(col, row, rgba);
+			for(int c = 0; c < nbChannels; c++)
+				*out++ = c < 4 ? rgba[c] : 0.0f;
+		}
+	return true;
+}
+
+//---------------------------------------------------------------------
+
+bool ImagePluginLibRaw::averagesCFASites(const pixelSpans &spans, float averages[4]) const
+{
+	if(!isDecoded())
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"]Cannot continue without a decoded mosaic."<<std::endl;
+		return false;
+	}
+
+	// ADU summed by site (each parity of a span row is a single site), normalized once at the end
+	const QRect	image		= decodedRegion();
+	std::uint64_t	sums[4]		= {0, 0, 0, 0};
+	std::size_t		counts[4]	= {0, 0, 0, 0};
+	for(const PixelSpan &span : spans)
+	{
+		if(span.width() <= 0)
+			continue;
+		if(!image.contains(QRect(span.xBegin, span.row, span.width(), 1)))
+		{
+			std::cout<<"["<<FILE_LINE_FUNC_STR<<"] ERROR occured. Some invalid pixel was detected...abort."<<std::endl;
+			return false;
+		}
+		const ushort *row = d->row(span.row);
+		for(int parity = 0; parity < 2; parity++)
+		{
+			int		x		= span.xBegin + ((span.xBegin & 1) != parity ? 1 : 0);
+			int		site	= d->mSite[span.row & 1][parity];
+			std::uint64_t sum = 0;
+			for(; x < span.xEnd; x += 2, counts[site]++)
+				sum += row[x];
+			sums[site] += sum;
+		}
+	}
+	for(int s = 0; s < 4; s++)
+		if(counts[s] == 0)
+			return false;
+
+	for(int s = 0; s < 4; s++)
+		averages[s] = float((double(sums[s]) / double(counts[s]) - d->mBlack[s]) / (d->mWhite - d->mBlack[s]));
+	return true;
+}
+
+//---------------------------------------------------------------------
+
+bool ImagePluginLibRaw::averagesChannels(const pixelsCoords &pixCoords, float &r, float &g, float &b, float &a) const
+{
+	return averagesChannels(makePixelSpans(pixCoords), r, g, b, a);
+}
+
+//---------------------------------------------------------------------
+
+bool ImagePluginLibRaw::averagesChannels(const pixelSpans &spans, float &r, float &g, float &b, float &a) const
+{
+	float averages[4];
+	if(!averagesCFASites(spans, averages))
+		return false;
+	r = averages[int(CFASite::R)];
+	g = 0.5f * (averages[int(CFASite::G1)] + averages[int(CFASite::G2)]);
+	b = averages[int(CFASite::B)];
+	a = 1.0f; // no alpha in a raw mosaic (like the other plugins)
+	return true;
+}
+
+//---------------------------------------------------------------------
+
+bool ImagePluginLibRaw::save(QString filename)
+{
+	QImage qimg = toQImage();
+	if(qimg.isNull())
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"]Cannot continue without a decoded mosaic."<<std::endl;
+		return false;
+	}
+	std::cout<<"Saving LibRaw quads image: "<<filename.toStdString()<<std::flush;
+	bool ok = qimg.save(filename);
+	std::cout<<(ok?" ...Done":"...FAILED")<<std::endl;
+	return ok;
+}
+
+#endif // USE_LIBRAW
+
+
+
+
+//---------------------------------------------------------------------
+//---------   ImagePluginGraphicsMagick  ------------------------------
+//---------------------------------------------------------------------
+
+#ifdef USE_GRAPHICSMAGICK
+
+#include <magick/api.h>
+
+#include <cstddef>
+#include <cstring>
+
+namespace
+{
+	/// GraphicsMagick is initialized once per process (its decoders threads are limited to the cores count)
+	void initializeGraphicsMagick()
+	{
+		static std::once_flag initialized;
+		std::call_once(initialized, []()
+			{
+				InitializeMagick(nullptr);
+				SetMagickResourceLimit(ThreadsResource, std::max(1u, std::thread::hardware_concurrency()));
+			} );
+	}
+
+	/// exception filled by a GraphicsMagick call, released when leaving the scope
+	struct GMException
+	{
+		GMException()	{GetExceptionInfo(&info);}
+		~GMException()	{DestroyExceptionInfo(&info);}
+		bool		failed() const	{return info.severity >= ErrorException;}
+		std::string	what() const	{return std::string(info.reason ? info.reason : "unknown error") + (info.description ? std::string(" (") + info.description + ")" : std::string());}
+		ExceptionInfo info;
+	};
+
+	typedef std::shared_ptr<::ImageInfo>	GMImageInfoPtr;
+	typedef std::shared_ptr<Image>			GMImagePtr;
+
+	/// read settings of a file
+	GMImageInfoPtr makeGMImageInfo(const QString &filename)
+	{
+		GMImageInfoPtr info(CloneImageInfo(nullptr), DestroyImageInfo);
+		std::strncpy(info->filename, filename.toLocal8Bit().constData(), MaxTextExtent-1);
+		return info;
+	}
+
+	GMImagePtr makeGMImage(Image *image) {return GMImagePtr(image, [](Image *img){if(img) DestroyImage(img);});}
+
+	/// EXIF rational attribute ("1/100", "28/10") of an image, 0 if missing
+	float exifValue(const Image *image, const char *key)
+	{
+		const ImageAttribute *attribute = GetImageAttribute(image, key);
+		if(attribute == nullptr || attribute->value == nullptr)
+			return 0.0f;
+		QStringList fraction = QString(attribute->value).split('/');
+		float denominator = fraction.size() > 1 ? fraction[1].toFloat() : 1.0f;
+		return denominator != 0.0f ? fraction[0].toFloat() / denominator : 0.0f;
+	}
+
+	/// storage index of the R,G,B channels and opacity inside a PixelPacket (its order depends on the endianness)
+	const int PacketRed		= int(offsetof(PixelPacket, red)	/ sizeof(Quantum));
+	const int PacketGreen	= int(offsetof(PixelPacket, green)	/ sizeof(Quantum));
+	const int PacketBlue	= int(offsetof(PixelPacket, blue)	/ sizeof(Quantum));
+	const int PacketOpacity	= int(offsetof(PixelPacket, opacity)/ sizeof(Quantum));
+
+	/// RGBA [0-1] of a pixel (GraphicsMagick stores the opacity : 0 is opaque)
+	void packetRGBA(const PixelPacket &pix, bool matte, float rgba[4])
+	{
+		rgba[0] = float(pix.red)	/ MaxRGBFloat;
+		rgba[1] = float(pix.green)	/ MaxRGBFloat;
+		rgba[2] = float(pix.blue)	/ MaxRGBFloat;
+		rgba[3] = matte ? 1.0f - float(pix.opacity) / MaxRGBFloat : 1.0f;
+	}
+
+	/// GraphicsMagick image to QImage (8 bits per channel : display only)
+	QImage gmToQImage(const Image *image, const std::function<bool(float)> &isCancelled)
+	{
+		GMException	exception;
+		ViewInfo	*view = OpenCacheView(const_cast<Image*>(image));
+		QImage		qimg(int(image->columns), int(image->rows), QImage::Format_RGBA8888);
+		for(int y = 0; y < qimg.height(); y++)
+		{
+			const PixelPacket *pix = AcquireCacheViewPixels(view, 0, y, image->columns, 1, &exception.info);
+			if(pix == nullptr || ((y & 63) == 0 && isCancelled(float(y) / qimg.height())))
+			{
+				qimg = QImage();
+				break;
+			}
+			uchar *line = qimg.scanLine(y);
+			for(int x = 0; x < qimg.width(); x++, pix++, line += 4)
+			{
+				line[0] = ScaleQuantumToChar(pix->red);
+				line[1] = ScaleQuantumToChar(pix->green);
+				line[2] = ScaleQuantumToChar(pix->blue);
+				line[3] = image->matte ? ScaleQuantumToChar(MaxRGB - pix->opacity) : 255;
+			}
+		}
+		CloseCacheView(view);
+		return qimg;
+	}
+}
+
+class ImagePluginGraphicsMagick::Private
+{
+public:
+	Private() : mState(LoadState::Unopened)
+	{}
+public:
+	QString		mFileName;
+	GMImagePtr	mImage;			///< decoded image (its pixels stay in the GraphicsMagick pixel cache)
+	QSize		mHeaderSize;	///< size read by loadImage()
+	LoadState	mState;
+};
+
+//---------------------------------------------------------------------
+
+ImagePluginGraphicsMagick::ImagePluginGraphicsMagick()
+	: ImagePlugin()
+	, d(new Private)
+{
+	initializeGraphicsMagick();
+}
+
+ImagePluginGraphicsMagick::~ImagePluginGraphicsMagick()
+{
+	delete d;
+}
+
+//---------------------------------------------------------------------
+
+QString ImagePluginGraphicsMagick::getImageFilterExtensions()
+{
+	// format: 'Image (*.png *.jpg *.bmp)')
+	GMException exception;
+	QStringList imageExts;
+	if(MagickInfo **formats = GetMagickInfoArray(&exception.info))
+	{
+		for(MagickInfo **format = formats; *format != nullptr; format++)
+			if((*format)->decoder != nullptr && (*format)->name != nullptr)
+				imageExts.append(QString("*.%1").arg(QString((*format)->name).toLower()));
+		MagickFree(formats);
+	}
+    return !imageExts.empty() ? QString("Image (%1)").arg(imageExts.join(" ")) : QString();
+}
+
+//---------------------------------------------------------------------
+
+ImagePlugin::ImageInfo ImagePluginGraphicsMagick::probe(QString filename) const
+{
+	// ping : the attributes without the pixels
+	ImageInfo		info;
+	GMException		exception;
+	GMImagePtr		image = makeGMImage(PingImage(makeGMImageInfo(filename).get(), &exception.info));
+	if(!image || exception.failed())
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] cannot read "<<filename.toStdString()<<": "<<exception.what()<<std::endl;
+		return info;
+	}
+	info.width			= int(image->columns);
+	info.height			= int(image->rows);
+	info.nbChannels		= (image->colorspace == GRAYColorspace ? 1 : 3) + (image->matte ? 1 : 0);
+	info.bitDepth		= int(image->depth);
+	info.exposureTime	= exifValue(image.get(), "EXIF:ExposureTime");
+	info.fNumber		= exifValue(image.get(), "EXIF:FNumber");
+	info.isoSpeed		= int(exifValue(image.get(), "EXIF:ISOSpeedRatings"));
+	return info;
+}
+
+//---------------------------------------------------------------------
+
+bool ImagePluginGraphicsMagick::loadImage(QString filename)
+{
+	d->mImage.reset();
+	d->mFileName	= filename;
+	d->mHeaderSize	= QSize();
+	d->mState		= LoadState::Unopened;
+
+	GMException	exception;
+	GMImagePtr	image = makeGMImage(PingImage(makeGMImageInfo(filename).get(), &exception.info));
+	if(!image || exception.failed())
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] cannot read "<<filename.toStdString()<<": "<<exception.what()<<std::endl;
+		return false;
+	}
+	d->mHeaderSize	= QSize(int(image->columns), int(image->rows));
+	d->mState		= LoadState::HeaderOnly;
+	return true;
+}
+
+//---------------------------------------------------------------------
+
+bool ImagePluginGraphicsMagick::decode()
+{
+	if(isDecoded())
+		return true;
+	if(d->mState != LoadState::HeaderOnly)
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] image not loaded...abort."<<std::endl;
+		return false;
+	}
+	// the GraphicsMagick progress monitor is process-wide : the decode can only be cancelled before it starts
+	if(progress(0.0f))
+		return false;
+
+	GMException	exception;
+	GMImagePtr	image = makeGMImage(ReadImage(makeGMImageInfo(d->mFileName).get(), &exception.info));
+	if(!image || exception.failed())
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] cannot decode "<<d->mFileName.toStdString()<<": "<<exception.what()<<std::endl;
+		return false;
+	}
+	d->mImage	= image;
+	d->mState	= LoadState::Decoded;
+	progress(1.0f);
+	return true;
+}
+
+QRect ImagePluginGraphicsMagick::decodedRegion() const
+{
+	return isDecoded() ? QRect(0, 0, int(d->mImage->columns), int(d->mImage->rows)) : QRect();
+}
+
+ImagePlugin::LoadState ImagePluginGraphicsMagick::loadState() const
+{
+	return d->mState;
+}
+
+ImagePlugin::PixelType ImagePluginGraphicsMagick::decodedType() const
+{
+	// pixel cache Quantum (build setting of GraphicsMagick)
+	if(!isDecoded())
+		return PixelType::UNKNOWN;
+	return QuantumDepth == 8 ? PixelType::UINT8 : QuantumDepth == 16 ? PixelType::UINT16 : PixelType::UNKNOWN;
+}
+
+//---------------------------------------------------------------------
+
+QImage ImagePluginGraphicsMagick::toQImage()
+{
+	if(!decode())
+		return QImage();
+	QImage qimg = gmToQImage(d->mImage.get(), [this](float done){return progress(done);});
+	if(!qimg.isNull())
+		progress(1.0f);
+	return qimg;
+}
+
+//---------------------------------------------------------------------
+
+QImage ImagePluginGraphicsMagick::preview(const QSize &maxSize) const
+{
+	// an other image : it can run while an other thread decode the image
+	if(d->mFileName.isEmpty())
+		return QImage();
+
+	// size hint : some decoders (JPEG) decode directly at a reduced size, then the thumbnail fit maxSize
+	GMImageInfoPtr info = makeGMImageInfo(d->mFileName);
+	CloneString(&info->size, QString("%1x%2").arg(maxSize.width()).arg(maxSize.height()).toLatin1().constData());
+	GMException	exception;
+	GMImagePtr	image = makeGMImage(ReadImage(info.get(), &exception.info));
+	if(!image || exception.failed())
+		return QImage();
+	if(image->columns > unsigned(maxSize.width()) || image->rows > unsigned(maxSize.height()))
+	{
+		QSize thumbSize = QSize(int(image->columns), int(image->rows)).scaled(maxSize, Qt::KeepAspectRatio);
+		GMImagePtr thumb = makeGMImage(ThumbnailImage(image.get(), unsigned(thumbSize.width()), unsigned(thumbSize.height()), &exception.info));
+		if(thumb)
+			image = thumb;
+	}
+	return gmToQImage(image.get(), [](float){return false;});
+}
+
+//---------------------------------------------------------------------
+
+QSize ImagePluginGraphicsMagick::size() const
+{
+	if(isDecoded())
+		return decodedRegion().size();
+	// header only
+	return d->mState == LoadState::HeaderOnly ? d->mHeaderSize : QSize();
+}
+
+//---------------------------------------------------------------------
+
+float ImagePluginGraphicsMagick::readSinglePixelChannel(int x, int y, int channel) const
+{
+	float rgba[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+	if(channel < 0 || channel > 3 || !readRegion(QRect(x, y, 1, 1), rgba, 4))
+		return 0.0f;
+	return rgba[channel];
+}
+
+//---------------------------------------------------------------------
+
+bool ImagePluginGraphicsMagick::readRegion(const QRect &region, float *pixels, int nbChannels) const
+{
+	if(!isDecoded())
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"]Cannot continue without a decoded image."<<std::endl;
+		return false;
+	}
+	if(!decodedRegion().contains(region) || pixels == nullptr || nbChannels < 1)
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] region is outside the image or output buffer is invalid...abort."<<std::endl;
+		return false;
+	}
+
+	// the whole region in one cache view request (a view per call : the reading threads never share one)
+	GMException			exception;
+	ViewInfo			*view	= OpenCacheView(d->mImage.get());
+	const PixelPacket	*pix	= AcquireCacheViewPixels(view, region.x(), region.y(), unsigned(region.width()), unsigned(region.height()), &exception.info);
+	if(pix != nullptr)
+	{
+		float *out = pixels;
+		std::size_t nbPixels = std::size_t(region.width()) * std::size_t(region.height());
+		for(std::size_t p = 0; p < nbPixels; p++, pix++)
+		{
+			float rgba[4];
+			packetRGBA(*pix, d->mImage->matte != MagickFalse, rgba);
+			for(int c = 0; c < nbChannels; c++)
+				*out++ = c < 4 ? rgba[c] : 0.0f;
+		}
+	}
+	CloseCacheView(view);
+	if(pix == nullptr)
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"] cannot read pixels: "<<exception.what()<<std::endl;
+		return false;
+	}
+	return true;
+}
+
+//---------------------------------------------------------------------
+
+bool ImagePluginGraphicsMagick::averagesChannels(const pixelsCoords &pixCoords, float &r, float &g, float &b, float &a) const
+{
+	return averagesChannels(makePixelSpans(pixCoords), r, g, b, a);
+}
+
+//---------------------------------------------------------------------
+
+bool ImagePluginGraphicsMagick::averagesChannels(const pixelSpans &spans, float &r, float &g, float &b, float &a) const
+{
+	if(!isDecoded())
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"]Cannot continue without a decoded image."<<std::endl;
+		return false;
+	}
+
+	// each span is a contiguous run of PixelPacket in the cache view : summed with the channels kernels for 8 and 16 bits quantums
+	const QRect			image	= decodedRegion();
+	GMException			exception;
+	ViewInfo			*view	= OpenCacheView(d->mImage.get());
+	std::uint64_t		sums[4]	= {0, 0, 0, 0};
+	std::size_t			nbPixels = 0;
+	bool				isRead	= true;
+	for(std::size_t i = 0; isRead && i < spans.size(); i++)
+	{
+		const PixelSpan &span = spans[i];
+		if(span.width() <= 0)
+			continue;
+		const PixelPacket *pix = image.contains(QRect(span.xBegin, span.row, span.width(), 1)) ?
+			AcquireCacheViewPixels(view, span.xBegin, span.row, unsigned(span.width()), 1, &exception.info) : nullptr;
+		if(!(isRead = pix != nullptr))
+			break;
+#if QuantumDepth == 8
+		ChannelKernels::sumUInt8(reinterpret_cast<const std::uint8_t*>(pix), std::size_t(span.width()), 4, sums);
+#elif QuantumDepth == 16
+		ChannelKernels::sumUInt16(reinterpret_cast<const std::uint16_t*>(pix), std::size_t(span.width()), 4, sums);
+#else
+		for(int x = 0; x < span.width(); x++, pix++)
+		{
+			const Quantum *channels = reinterpret_cast<const Quantum*>(pix);
+			for(int c = 0; c < 4; c++)
+				sums[c] += channels[c];
+		}
+#endif
+		nbPixels += std::size_t(span.width());
+	}
+	CloseCacheView(view);
+	if(!isRead)
+	{
+		std::cout<<"["<<FILE_LINE_FUNC_STR<<"] ERROR occured. Some invalid pixel was detected...abort. "<<exception.what()<<std::endl;
+		return false;
+	}
+	if(nbPixels == 0)
+		return false;
+
+	double scale = 1.0 / (MaxRGBDouble * double(nbPixels));
+	r = float(double(sums[PacketRed])	* scale);
+	g = float(double(sums[PacketGreen])	* scale);
+	b = float(double(sums[PacketBlue])	* scale);
+	a = d->mImage->matte ? float(1.0 - double(sums[PacketOpacity]) * scale) : 1.0f;
+	return true;
+}
+
+//---------------------------------------------------------------------
+
+bool ImagePluginGraphicsMagick::save(QString filename)
+{
+	if(!decode())
+	{
+		std::cerr<<"["<<FILE_LINE_FUNC_STR<<"]Cannot continue without a decoded image."<<std::endl;
+		return false;
+	}
+	// the format is given by the file extension
+	std::cout<<"Saving GraphicsMagick image: "<<filename.toStdString()<<std::flush;
+	GMImageInfoPtr info = makeGMImageInfo(filename);
+	std::strncpy(d->mImage->filename, info->filename, MaxTextExtent-1);
+	bool ok = WriteImage(info.get(), d->mImage.get()) != MagickFail;
+	std::cout<<(ok?" ...Done":"...FAILED")<<std::endl;
+	return ok;
+}
+
+#endif // USE_GRAPHICSMAGICK
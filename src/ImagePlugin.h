@@ -2,52 +2,183 @@
 
 #include <QString>
 #include <QImage>
+#include <QRect>
+#include <QStringList>
 
 #include <vector>
 #include <utility>
+#include <cstddef>
+#include <iosfwd>
+#include <functional>
 
+/// Image SDK abstraction used to load an image and measure its pixels.
+///
+/// Lifecycle : loadImage() open the file (at most its header is read), decode() put the pixels in memory once.
+/// Thread-safe read contract : once decode() returned true, the const read methods (size(), readSinglePixelChannel(),
+/// readRegion(), pixelView() and averagesChannels()) are re-entrant and never mutate the plugin, so many threads
+/// can sample the same image without locks. They fail (without decoding) if the image is not decoded.
+/// loadImage(), decode(), toColorSpace(), toQImage() and save() must not run while other threads are reading.
 class ImagePlugin
 {
+public:
+	/// Progress hook of the long operations (decode(), decodeRegion(), toQImage(), toColorSpace()) : called with the done portion [0-1]
+	/// from the thread running the operation. Returning true cancel it : the operation then fails and the state is left unchanged.
+	typedef std::function<bool(float done)> ProgressCallback;
+
 protected:
 	/// it's up to the sub class to internaly activate this option
 	QString mColorSpace;
 
+	ProgressCallback mProgressCallback;
+
+	/// report progress of the current operation, return true if it has to be cancelled
+	bool	progress(float done) const {return mProgressCallback ? mProgressCallback(done) : false;}
+
 public:
 	typedef std::pair<int,int>		pixelCoord;
 	typedef std::vector<pixelCoord> pixelsCoords;
 	static	pixelCoord makePixelCoord(int x, int y){return std::make_pair(x, y);}
 
+	/// Run of consecutive pixels [xBegin, xEnd[ on a row (compact alternative to pixelsCoords)
+	struct PixelSpan
+	{
+		PixelSpan(int y = 0, int xb = 0, int xe = 0) : row(y), xBegin(xb), xEnd(xe) {}
+		int row, xBegin, xEnd;
+		int width() const {return xEnd - xBegin;}
+	};
+	typedef std::vector<PixelSpan> pixelSpans;
+
+	/// Gather consecutive pixels coords of a same row into spans
+	static	pixelSpans makePixelSpans(const pixelsCoords &pixCoords);
+
+	enum class PixelType {UNKNOWN, UINT8, UINT16, HALF, FLOAT};
+
+	/// Image description read from the file header only (no pixels decoding), 0 or empty when unknown
+	struct ImageInfo
+	{
+		ImageInfo() : width(0), height(0), nbChannels(0), bitDepth(0), exposureTime(0.0f), fNumber(0.0f), isoSpeed(0)
+		{}
+
+		int		width, height;
+		int		nbChannels;
+		int		bitDepth;		///< bits per channel stored in the file
+		QString	colorSpace;		///< colorspace declared by the file (if any)
+		float	exposureTime;	///< EXIF exposure time (seconds)
+		float	fNumber;		///< EXIF aperture
+		int		isoSpeed;		///< EXIF ISO speed
+
+		bool	isValid() const {return width > 0 && height > 0;}
+	};
+
+	/// Lifecycle of the image held by a plugin, each transition is done at most once per loadImage() :
+	/// Unopened -loadImage()-> HeaderOnly -decode()-> Decoded (see decodedType()) -toColorSpace()-> Converted (see colorSpace())
+	enum class LoadState {Unopened, HeaderOnly, Decoded, Converted};
+	static const char* loadStateName(LoadState state);
+
+	/// Read-only view on the decoded pixels memory of a plugin (no copy, no per pixel call).
+	/// It stays valid until the image is reloaded or converted by the plugin.
+	struct PixelView
+	{
+		PixelView() : data(nullptr), type(PixelType::UNKNOWN), nbChannels(0), pixelStride(0), rowStride(0)
+		{ channelIndex[0] = channelIndex[1] = channelIndex[2] = channelIndex[3] = -1; }
+
+		const unsigned char*	data;				///< first pixel of rect (upper left)
+		PixelType				type;				///< type of each stored channel
+		QRect					rect;				///< pixels area available in the image pixel coord system
+		int						nbChannels;			///< number of channels stored per pixel
+		int						channelIndex[4];	///< storage index of the R,G,B,A channels inside a pixel (-1 if not stored)
+		std::ptrdiff_t			pixelStride;		///< bytes between 2 consecutive pixels of a row
+		std::ptrdiff_t			rowStride;			///< bytes between 2 consecutive rows
+
+		bool					isValid() const					{return data != nullptr && type != PixelType::UNKNOWN && nbChannels > 0;}
+		const unsigned char*	pixel(int x, int y) const		{return data + (y - rect.y())*rowStride + (x - rect.x())*pixelStride;}
+		const unsigned char*	scanLine(int y) const			{return data + (y - rect.y())*rowStride;}
+	};
+
+	/// Factory of a new plugin instance (owned by the caller)
+	typedef std::function<ImagePlugin*()> Factory;
+	/// Image plugins built in this binary (SDK name, factory) in the ImageSDK menu order (e.g. to compare them on a same chart)
+	static std::vector< std::pair<QString, Factory> > registeredPlugins();
+
 public:
-	bool	withColorSpaceHandler()	{return mColorSpace.isEmpty() ? false : true;}
-	QString	colorSpace()			{return mColorSpace;}
+	void	setProgressCallback(ProgressCallback callback) {mProgressCallback = callback;}
+
+	bool	withColorSpaceHandler()	const {return mColorSpace.isEmpty() ? false : true;}
+	QString	colorSpace()			const {return mColorSpace;}
 	bool	toColorSpace(QString colorSpaceName) {mColorSpace=colorSpaceName; return colorSpaceConversion();}
 
 protected:
 	/// need to be overloaded by subclass supporting colorspace and should use mColorSpace
 	virtual bool colorSpaceConversion() {return false;}
 
+	/// Averages computation shared by plugins able to expose a PixelView : runs of consecutive pixels are summed with the ChannelKernels.
+	/// Return false (without touching r,g,b,a) if the view layout or a pixel coord is not handled, so the caller can use its own path.
+	static bool averagesChannelsFromView(const PixelView &view, const pixelSpans &spans, float &r, float &g, float &b, float &a);
+
 public:
     /// Use as filter menu on Open (example: 'Image (*.png *.jpg *.bmp)')
     virtual QString getImageFilterExtensions() = 0;
     
-	/// Load the image in memory for next use
+	/// Read the file header only : does not change the opened image (nor its state), invalid info if the file cannot be read
+	virtual ImageInfo	probe(QString filename) const = 0;
+
+	/// Open the image for next use (no pixels decoding, see decode())
 	virtual bool	loadImage(QString filename) = 0;
 
-	/// Get a conversion to a QImage (allow to show something into the GUI)
+	/// Decode the pixels of the opened image in memory (explicit step, done only once per loadImage)
+	virtual bool	decode() = 0;
+
+	/// Decode only the pixels inside region (image pixel coord system) instead of the whole image.
+	/// The read methods then fail outside decodedRegion(). Default : decode the whole image.
+	virtual bool	decodeRegion(const QRect &region) {return decode();}
+	/// Pixels area available in memory (empty before decode())
+	virtual QRect	decodedRegion() const = 0;
+
+	/// Current lifecycle state (never change by itself : only loadImage(), decode() and toColorSpace() move it)
+	virtual LoadState	loadState() const = 0;
+	/// Type of the decoded pixels in memory (UNKNOWN before decode())
+	virtual PixelType	decodedType() const = 0;
+	bool				isDecoded() const {return loadState() == LoadState::Decoded || loadState() == LoadState::Converted;}
+
+	/// Get a conversion to a QImage (allow to show something into the GUI), decode the image if needed
 	virtual QImage	toQImage() = 0;
 
+	/// Get a low resolution QImage of the opened image fitting in maxSize (only for display, never measured).
+	/// Read from the file by the cheapest way the SDK provides : does not decode the image nor change its state,
+	/// so it can be called while an other thread run decode().
+	virtual QImage	preview(const QSize &maxSize) const = 0;
+
 	/// Get the image resolution
-	virtual QSize	size() = 0;
+	virtual QSize	size() const = 0;
+
+	virtual float readSinglePixelChannel(int x, int y, int channel) const = 0;
 
-	virtual float readSinglePixelChannel(int x, int y, int channel) = 0;
+	/// Read a whole region in one call into a caller-provided buffer (row by row, nbChannels interleaved float [0-1] per pixel).
+	/// The buffer must hold at least region.width()*region.height()*nbChannels floats.
+	/// Channels missing from the image are filled with 0 (or 1 for alpha).
+	virtual bool readRegion(const QRect &region, float *pixels, int nbChannels = 4) const = 0;
+
+	/// Get a read-only view on the decoded pixels (invalid view if the plugin cannot expose its memory)
+	virtual PixelView pixelView() const {return PixelView();}
 
 	/// Get the averages pixel channels given a list of pixel coord x,y
-	virtual bool averagesChannels(pixelsCoords pixCoords, float &r, float &g, float &b, float &a) = 0;
+	virtual bool averagesChannels(const pixelsCoords &pixCoords, float &r, float &g, float &b, float &a) const = 0;
+
+	/// Get the averages pixel channels given a list of pixels spans (allow to stream contiguous pixels memory)
+	virtual bool averagesChannels(const pixelSpans &spans, float &r, float &g, float &b, float &a) const = 0;
+
+	/// Streaming measurement : averages of several spans lists (e.g. all the patches) in one pass over the file by bands of rows,
+	/// each band is discarded once summed so the peak memory is bounded by the band size (the image is never decoded, state unchanged).
+	/// averages receive 4 floats (r,g,b,a) per spans list (r=g=b for a gray image, a = 1 without alpha, like averagesChannels). Need loadImage() only.
+	/// Default : decode() then averagesChannels() for each list.
+	virtual bool streamAveragesChannels(const std::vector<pixelSpans> &spansLists, std::vector<float> &averages);
 
 	/// Try to write an output filename from the opened/loaded image (based on the file extension) 
 	virtual bool save(QString filename) = 0;
 };
 
+std::ostream& operator<<(std::ostream &stream, const ImagePlugin::ImageInfo &info);
+
 //---------------------------------------------------------------------
 //---------------------------------------------------------------------
 
@@ -60,11 +191,20 @@ public:
 public:
     /// create filter string for all formats supported by QImage
     virtual QString getImageFilterExtensions();
+	virtual ImageInfo	probe(QString filename) const;
 	virtual bool	loadImage(QString filename);
+	virtual bool	decode();
+	virtual QRect	decodedRegion() const;
+	virtual LoadState	loadState() const;
+	virtual PixelType	decodedType() const;
 	virtual QImage	toQImage();
-	virtual QSize	size();
-	virtual float	readSinglePixelChannel(int x, int y, int channel);
-	virtual bool	averagesChannels(pixelsCoords pixCoords, float &r, float &g, float &b, float &a);
+	virtual QImage	preview(const QSize &maxSize) const;
+	virtual QSize	size() const;
+	virtual float	readSinglePixelChannel(int x, int y, int channel) const;
+	virtual bool	readRegion(const QRect &region, float *pixels, int nbChannels = 4) const;
+	virtual PixelView pixelView() const;
+	virtual bool	averagesChannels(const pixelsCoords &pixCoords, float &r, float &g, float &b, float &a) const;
+	virtual bool	averagesChannels(const pixelSpans &spans, float &r, float &g, float &b, float &a) const;
 	virtual bool	save(QString filename);
 
 private:
@@ -84,17 +224,173 @@ public:
 protected:
 	virtual bool colorSpaceConversion();
 
+	/// OIIO ProgressCallback forwarding to progress() (opaque data is the plugin)
+	static bool oiioProgress(void *plugin, float done);
+
 public:
+	/// Back the next loaded images by the process-wide OIIO ImageCache instead of a local float buffer :
+	/// tiles are paged in on demand under maxMemoryMB (shared by all the plugins using it), scanline files are split in autotile tiles.
+	/// maxMemoryMB <= 0 goes back to the local buffer (default).
+	void	useImageCache(float maxMemoryMB, int autotile = 64);
+	bool	withImageCache() const;
+
     /// create filter string for all formats supported by QImage
 	virtual QString getImageFilterExtensions();
+	virtual ImageInfo	probe(QString filename) const;
 	virtual bool	loadImage(QString filename);
+	virtual bool	decode();
+	virtual bool	decodeRegion(const QRect &region);
+	virtual QRect	decodedRegion() const;
+	virtual LoadState	loadState() const;
+	virtual PixelType	decodedType() const;
 	virtual QImage	toQImage();
-	virtual QSize	size();
-	virtual float	readSinglePixelChannel(int x, int y, int channel);
-	virtual bool	averagesChannels(pixelsCoords pixCoords, float &r, float &g, float &b, float &a);
+	virtual QImage	preview(const QSize &maxSize) const;
+	virtual QSize	size() const;
+	virtual float	readSinglePixelChannel(int x, int y, int channel) const;
+	virtual bool	readRegion(const QRect &region, float *pixels, int nbChannels = 4) const;
+	virtual PixelView pixelView() const;
+	virtual bool	averagesChannels(const pixelsCoords &pixCoords, float &r, float &g, float &b, float &a) const;
+	virtual bool	averagesChannels(const pixelSpans &spans, float &r, float &g, float &b, float &a) const;
+	virtual bool	streamAveragesChannels(const std::vector<pixelSpans> &spansLists, std::vector<float> &averages);
 	virtual bool	save(QString filename);
 
 private:
     class Private;
     Private *d;
-};
\ No newline at end of file
+};
+//---------------------------------------------------------------------
+//---------------------------------------------------------------------
+
+/// OpenEXR files read natively with Imf (scanline or tiled, multi-part files when built with OpenEXR 2) by all the cores :
+/// only the R,G,B(,A) channels of one layer are decoded (or Y(,A) for luminance images), bands of scanlines at a time.
+/// HALF channels stay HALF in memory and are summed by the half kernels (other types are stored as FLOAT).
+/// Pixels coords are relative to the data window origin. Values are not clamped (HDR).
+class ImagePluginOpenEXR : public ImagePlugin
+{
+public:
+	ImagePluginOpenEXR();
+	virtual ~ImagePluginOpenEXR();
+
+public:
+	/// layer read at next loadImage() (e.g. "diffuse" for the "diffuse.R", "diffuse.G"... channels), empty for the default layer (default)
+	void		setLayer(const QString &layer);
+	QString		layer() const;
+	/// layers of the opened file holding R,G,B or Y channels (the default layer is the empty name), all parts included
+	QStringList	layers() const;
+
+    /// create filter string for OpenEXR files
+	virtual QString getImageFilterExtensions();
+	virtual ImageInfo	probe(QString filename) const;
+	virtual bool	loadImage(QString filename);
+	virtual bool	decode();
+	virtual QRect	decodedRegion() const;
+	virtual LoadState	loadState() const;
+	virtual PixelType	decodedType() const;
+	virtual QImage	toQImage();
+	virtual QImage	preview(const QSize &maxSize) const;
+	virtual QSize	size() const;
+	virtual float	readSinglePixelChannel(int x, int y, int channel) const;
+	virtual bool	readRegion(const QRect &region, float *pixels, int nbChannels = 4) const;
+	virtual PixelView pixelView() const;
+	virtual bool	averagesChannels(const pixelsCoords &pixCoords, float &r, float &g, float &b, float &a) const;
+	virtual bool	averagesChannels(const pixelSpans &spans, float &r, float &g, float &b, float &a) const;
+	virtual bool	save(QString filename);
+
+private:
+    class Private;
+    Private *d;
+};
+
+//---------------------------------------------------------------------
+//---------------------------------------------------------------------
+
+#ifdef USE_LIBRAW
+
+/// Raw files (CR2, NEF, ARW, DNG...) read directly with LibRaw : the undemosaiced Bayer mosaic is kept as stored by the sensor
+/// (no demosaic, no white balance, no curve), so the measurement stays true to the sensor linearity.
+/// Pixels coords are the visible area of the sensor (not rotated by the EXIF orientation).
+/// The RGB read methods (readRegion(), toQImage()...) give the 2x2 CFA quad holding the pixel (greens averaged),
+/// averagesChannels() averages each CFA site of the pixels (see averagesCFASites()) : R, (G1+G2)/2, B and alpha 0.
+/// Values are black subtracted and normalized by the white level (not clamped). Only 2x2 RGB Bayer patterns are handled.
+class ImagePluginLibRaw : public ImagePlugin
+{
+public:
+	/// sites of the 2x2 Bayer pattern : G1 is the green of the red rows, G2 the green of the blue rows
+	enum class CFASite {R, G1, G2, B};
+
+	ImagePluginLibRaw();
+	virtual ~ImagePluginLibRaw();
+
+public:
+	/// averages of each CFA site of the spans pixels (indexed by CFASite), measured on the mosaic : false if a site has no pixel
+	bool	averagesCFASites(const pixelSpans &spans, float averages[4]) const;
+
+	/// black level of a site and white level of the raw data (sensor ADU), 0 before decode()
+	float	blackLevel(CFASite site) const;
+	float	whiteLevel() const;
+
+	/// read-only view on the mosaic (one UINT16 ADU per pixel, its CFA site is given by cfaSite()), invalid before decode()
+	PixelView	mosaicView() const;
+	CFASite		cfaSite(int x, int y) const;
+
+    /// create filter string for the raw formats supported by LibRaw
+	virtual QString getImageFilterExtensions();
+	virtual ImageInfo	probe(QString filename) const;
+	virtual bool	loadImage(QString filename);
+	virtual bool	decode();
+	virtual QRect	decodedRegion() const;
+	virtual LoadState	loadState() const;
+	virtual PixelType	decodedType() const;
+	virtual QImage	toQImage();
+	virtual QImage	preview(const QSize &maxSize) const;
+	virtual QSize	size() const;
+	virtual float	readSinglePixelChannel(int x, int y, int channel) const;
+	virtual bool	readRegion(const QRect &region, float *pixels, int nbChannels = 4) const;
+	virtual bool	averagesChannels(const pixelsCoords &pixCoords, float &r, float &g, float &b, float &a) const;
+	virtual bool	averagesChannels(const pixelSpans &spans, float &r, float &g, float &b, float &a) const;
+	virtual bool	save(QString filename);
+
+private:
+    class Private;
+    Private *d;
+};
+
+#endif // USE_LIBRAW
+
+//---------------------------------------------------------------------
+//---------------------------------------------------------------------
+
+#ifdef USE_GRAPHICSMAGICK
+
+/// Images read with GraphicsMagick (its decoders use all the cores) : the decoded image stay in the GraphicsMagick pixel cache
+/// and every read goes through a cache view of its own (bulk region access, no lock between the reading threads).
+class ImagePluginGraphicsMagick : public ImagePlugin
+{
+public:
+	ImagePluginGraphicsMagick();
+	virtual ~ImagePluginGraphicsMagick();
+
+public:
+    /// create filter string for all formats GraphicsMagick can decode
+	virtual QString getImageFilterExtensions();
+	virtual ImageInfo	probe(QString filename) const;
+	virtual bool	loadImage(QString filename);
+	virtual bool	decode();
+	virtual QRect	decodedRegion() const;
+	virtual LoadState	loadState() const;
+	virtual PixelType	decodedType() const;
+	virtual QImage	toQImage();
+	virtual QImage	preview(const QSize &maxSize) const;
+	virtual QSize	size() const;
+	virtual float	readSinglePixelChannel(int x, int y, int channel) const;
+	virtual bool	readRegion(const QRect &region, float *pixels, int nbChannels = 4) const;
+	virtual bool	averagesChannels(const pixelsCoords &pixCoords, float &r, float &g, float &b, float &a) const;
+	virtual bool	averagesChannels(const pixelSpans &spans, float &r, float &g, float &b, float &a) const;
+	virtual bool	save(QString filename);
+
+private:
+    class Private;
+    Private *d;
+};
+
+#endif // USE_GRAPHICSMAGICK
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// Run task(i) for each i in [0, count[ using nbWorkers threads (the calling thread is one of them).
+/// Each worker pull the next index from a shared counter, so each task run exactly once and should only write its own results.
+/// nbWorkers <= 0 means one worker per hardware thread.
+/// The first exception thrown by a task stops the remaining tasks and is rethrown in the calling thread.
+inline void parallelFor(int count, int nbWorkers, const std::function<void(int)> &task)
+{
+	if(nbWorkers <= 0)
+		nbWorkers = std::max(1, int(std::thread::hardware_concurrency()));
+	nbWorkers = std::min(nbWorkers, count);
+
+	if(nbWorkers <= 1)
+	{
+		for(int i = 0; i < count; i++)
+			task(i);
+		return;
+	}
+
+	std::atomic<int>	next(0);
+	std::exception_ptr	error;
+	std::mutex			errorMutex;
+	auto worker = [&]()
+	{
+		for(int i = next++; i < count; i = next++)
+		{
+			try { task(i); }
+			catch(...)
+			{
+				std::lock_guard<std::mutex> lock(errorMutex);
+				if(!error)
+					error = std::current_exception();
+				next = count;
+			}
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for(int w = 1; w < nbWorkers; w++)
+		threads.push_back(std::thread(worker));
+	worker();
+	for(std::thread &thread : threads)
+		thread.join();
+
+	if(error)
+		std::rethrow_exception(error);
+}
@@ -2,12 +2,19 @@
 #include "ui_mainwindow.h" //=> this include qcustomplot.h
 #include "ImagePlugin.h"
 #include "ColorSwatch.h"
+#include "ColorSwatchLoader.h"
+#include "ColorSwatchComparison.h"
 #include "PreBuildUtil.h"
 
 #include <QDesktopWidget>
 #include <QImage>
 #include <QMessageBox>
+#include <QPainter>
+#include <QProgressBar>
+#include <QPushButton>
+#include <QThread>
 
+#include <atomic>
 #include <iostream>
 #include <memory>
 
@@ -19,6 +26,12 @@ public:
         , mTitle("Color Swatch Munsell Neutral Value Scale test kit")
 		, mImgPlg(std::unique_ptr<ImagePluginQt>(new ImagePluginQt))
 		, mColorSwatch(std::shared_ptr<ColorSwatch>(nullptr))
+		, mProgressBar(nullptr)
+		, mCancelButton(nullptr)
+		, mCancelRequested(false)
+		, mBusy(false)
+		, mLoaderThread(nullptr)
+		, mNbComparedSDKs(0)
     {}
     
 	std::unique_ptr<Ui::MainWindow> mUi;
@@ -30,6 +43,16 @@ public:
 	std::shared_ptr<ColorSwatch>	mColorSwatch;
 
 	QString							mOpenedImgFilePath;
+
+	QImage							mDisplayImg; ///< image shown in the label (rescaled to the label size on resize)
+
+	QProgressBar*					mProgressBar;		///< status bar progress of the image plugin operations (owned by the status bar)
+	QPushButton*					mCancelButton;		///< status bar cancel of the image plugin operations (owned by the status bar)
+	std::atomic<bool>				mCancelRequested;	///< read by the progress callback from the loader thread
+	bool							mBusy;				///< an operation shows its progress : the events it processes must not start an other one
+
+	QThread*						mLoaderThread;		///< running ColorSwatchLoader or ColorSwatchComparison thread (nullptr when idle)
+	int								mNbComparedSDKs;	///< ImageSDKs graphs added by the running (or last) comparison
 };
 
 //---------------------------------------------------------------------
@@ -50,11 +73,29 @@ SwatchMainWindow::SwatchMainWindow(QWidget *parent)
     statusBar()->clearMessage();
 
     d->mUi->customPlot->replot();
+
+	// progress and cancel of the long image plugin operations (decode, conversions)
+	d->mProgressBar		= new QProgressBar(this);
+	d->mCancelButton	= new QPushButton(tr("Cancel"), this);
+	d->mProgressBar->setRange(0, 100);
+	d->mProgressBar->setMaximumWidth(200);
+	d->mUi->statusBar->addPermanentWidget(d->mProgressBar);
+	d->mUi->statusBar->addPermanentWidget(d->mCancelButton);
+	connect(d->mCancelButton, &QPushButton::clicked, [this](){ d->mCancelRequested = true; });
+	showProgress(false);
+	installProgressCallback();
+
 	createConnexionsMenu();
 }
 
 SwatchMainWindow::~SwatchMainWindow()
 {
+	// the loader uses our image plugin : stop it before releasing the plugin
+	if(d->mLoaderThread)
+	{
+		d->mCancelRequested = true;
+		d->mLoaderThread->wait();
+	}
     delete d;
 }
 
@@ -69,29 +110,40 @@ ImagePlugin* SwatchMainWindow::getImgPlugin()
 
 bool SwatchMainWindow::loadColorWatchSettings(QString iniFile)
 {
+	if(d->mLoaderThread)
+		return false; // one loading at a time (menus are disabled meanwhile)
+
 	d->mColorSwatch.reset(new ColorSwatch(d->mImgPlg.get()));
 
-	bool isLoaded = false;
-	try							
-	{ 
-		if( isLoaded = d->mColorSwatch->loadSettings(d->mLoadedSettingsFilePath) )
-		{
-			if( isLoaded = d->mColorSwatch->loadImages() )
-			{
-				isLoaded = d->mColorSwatch->fillPatchesPixelsFromMask();
-				createGraph(d->mColorSwatch->getGraphData(ColorSwatch::DATA::REF),
-					d->mColorSwatch->getGraphData(ColorSwatch::DATA::R),
-					d->mColorSwatch->getGraphData(ColorSwatch::DATA::G),
-					d->mColorSwatch->getGraphData(ColorSwatch::DATA::B),
-					d->mColorSwatch->getGraphData(ColorSwatch::DATA::A)
-				);
-			}
-		}
-	}
-	catch(std::exception &e) { std::cerr<<"[Failed to load settings] "+std::string(e.what())<<std::endl; isLoaded=false;}
+	// the loading stages run in a worker thread : the GUI shows their results as soon as they are ready
+	QThread*			thread = new QThread;
+	ColorSwatchLoader*	loader = new ColorSwatchLoader(d->mColorSwatch, d->mImgPlg.get(), iniFile, QApplication::desktop()->screenGeometry().size());
+	loader->moveToThread(thread);
+	d->mLoaderThread = thread;
+
+	connect(thread, &QThread::started,					loader, &ColorSwatchLoader::run);
+	connect(loader, &ColorSwatchLoader::previewReady,	this, &SwatchMainWindow::showImage);
+	connect(loader, &ColorSwatchLoader::imageReady,		this, &SwatchMainWindow::showImage);
+	connect(loader, &ColorSwatchLoader::patchesReady,	this, &SwatchMainWindow::showPatches);
+	connect(loader, &ColorSwatchLoader::graphReady,		this, &SwatchMainWindow::createGraph);
+	connect(loader, &ColorSwatchLoader::finished,		this, &SwatchMainWindow::colorWatchSettingsLoaded);
+	connect(loader, &ColorSwatchLoader::finished,		thread, &QThread::quit, Qt::DirectConnection); // not queued to a GUI thread that may wait for it
+	connect(thread, &QThread::finished,					loader, &QObject::deleteLater);
+	connect(thread, &QThread::finished,					thread, &QObject::deleteLater);
+
+	showProgress(true);
+	d->mUi->statusBar->showMessage( tr("Loading Color Swatch Settings : ") + iniFile );
+	thread->start();
+	return true;
+}
+
+void SwatchMainWindow::colorWatchSettingsLoaded(bool isLoaded, const QString &error)
+{
+	d->mLoaderThread = nullptr; // deleted once its event loop quits
+	showProgress(false);
 
-	if(d->mColorSwatch->haveImage())
-		d->mUi->label->setPixmap( QPixmap::fromImage( d->mColorSwatch->getQImage().scaled(d->mUi->label->size(),Qt::KeepAspectRatio) ) );
+	if(!error.isEmpty())
+		std::cerr<<"[Failed to load settings] "+error.toStdString()<<std::endl;
 
 	d->mUi->statusBar->showMessage( 
 		(isLoaded ? 
@@ -101,8 +153,74 @@ bool SwatchMainWindow::loadColorWatchSettings(QString iniFile)
 		+ d->mLoadedSettingsFilePath );
 
 	std::cout<<"\n"<<*d->mColorSwatch.get()<<"\n"<<std::endl; // verbose
+}
 
-	return isLoaded;
+//---------------------------------------------------------------------
+
+bool SwatchMainWindow::compareImageSDKs()
+{
+	if(d->mLoaderThread)
+		return false; // one loading at a time (menus are disabled meanwhile)
+
+	// the patches geometry is needed (extracted from the mask by the last loading)
+	if(!d->mColorSwatch || d->mColorSwatch->patchesRects().isEmpty() || d->mColorSwatch->patchesRects().first().isNull() || d->mLoadedSettingsFilePath.isEmpty())
+	{
+		d->mUi->statusBar->showMessage( tr("Load Color Swatch Settings before comparing the ImageSDKs.") );
+		return false;
+	}
+
+	// every ImageSDK decodes the raw image in its own thread and measures the patches geometry of the loaded ColorSwatch
+	// (the progress is the mean of all the ImageSDKs, reported from their threads)
+	QThread*				thread		= new QThread;
+	ColorSwatchComparison*	comparison	= new ColorSwatchComparison(*d->mColorSwatch, d->mImgPlg.get(), d->mLoadedSettingsFilePath,
+		[this](float done)
+		{
+			QMetaObject::invokeMethod(d->mProgressBar, "setValue", Qt::QueuedConnection, Q_ARG(int, int(done * 100.0f)));
+			return d->mCancelRequested.load();
+		}
+	);
+	comparison->moveToThread(thread);
+	d->mLoaderThread	= thread;
+	d->mNbComparedSDKs	= 0;
+
+	connect(thread,		&QThread::started,						comparison, &ColorSwatchComparison::run);
+	connect(comparison, &ColorSwatchComparison::pluginMeasured,	this, &SwatchMainWindow::addComparedGraph);
+	connect(comparison, &ColorSwatchComparison::deltasReady,	this, [](const QString &table){ std::cout<<"\n"<<table.toStdString()<<std::endl; }); // verbose
+	connect(comparison, &ColorSwatchComparison::finished,		this, &SwatchMainWindow::imageSDKsCompared);
+	connect(comparison, &ColorSwatchComparison::finished,		thread, &QThread::quit, Qt::DirectConnection); // not queued to a GUI thread that may wait for it
+	connect(thread,		&QThread::finished,						comparison, &QObject::deleteLater);
+	connect(thread,		&QThread::finished,						thread, &QObject::deleteLater);
+
+	// the compared ImageSDKs graphs replace the current ones (the reference line stays)
+	ColorSwatch::GraphData2D graphRef = d->mColorSwatch->getGraphData(ColorSwatch::DATA::REF);
+	d->mUi->customPlot->clearGraphs();
+	d->mUi->customPlot->addGraph();
+	d->mUi->customPlot->graph(0)->setPen(QPen(Qt::lightGray));
+	d->mUi->customPlot->graph(0)->setName("reference");
+	d->mUi->customPlot->graph(0)->setData(graphRef.first, graphRef.second);
+	d->mUi->customPlot->legend->setVisible(true);
+	d->mUi->customPlot->legend->removeAt(0);
+	d->mUi->customPlot->replot();
+
+	showProgress(true);
+	d->mUi->statusBar->showMessage( tr("Comparing ImageSDKs : ") + d->mLoadedSettingsFilePath );
+	thread->start();
+	return true;
+}
+
+void SwatchMainWindow::imageSDKsCompared(bool isCompared, const QString &error)
+{
+	d->mLoaderThread = nullptr; // deleted once its event loop quits
+	showProgress(false);
+
+	if(!error.isEmpty())
+		std::cerr<<"[ImageSDKs not measured]\n"+error.toStdString()<<std::endl;
+
+	d->mUi->statusBar->showMessage( 
+		(isCompared ? 
+			tr("ImageSDKs compared [%1 measured] : ").arg(d->mNbComparedSDKs)
+			: d->mCancelRequested ? tr("ImageSDKs comparison cancelled: ") : tr("ImageSDKs NOT compared: "))
+		+ d->mLoadedSettingsFilePath );
 }
 
 //---------------------------------------------------------------------
@@ -117,12 +235,16 @@ bool SwatchMainWindow::openImage(QString)
 			d->mColorSwatch.reset();
 			std::cout<<"\nReset ColorWatch data structure\n"<<std::endl; // verbose
 		}
-		d->mUi->label->setPixmap( QPixmap::fromImage( d->mImgPlg->toQImage().scaled(d->mUi->label->size(),Qt::KeepAspectRatio) ) );
+		// show a low resolution preview (large enough for the screen) before decoding the full image
+		showImage( d->mImgPlg->preview(QApplication::desktop()->screenGeometry().size()) );
+		showProgress(true);
+		isLoaded = d->mImgPlg->decode();
+		showProgress(false);
 	}
 
-	QString msg = (isLoaded ? tr("Image loaded: ") : tr("Image NOT loaded: ")) + d->mOpenedImgFilePath;
+	QString msg = (isLoaded ? tr("Image loaded: ") : d->mCancelRequested ? tr("Image loading cancelled: ") : tr("Image NOT loaded: ")) + d->mOpenedImgFilePath;
 	d->mUi->statusBar->showMessage(msg);
-	std::cout<<msg.toStdString()<<std::endl;
+	std::cout<<msg.toStdString()<<" ["<<ImagePlugin::loadStateName(d->mImgPlg->loadState())<<"]"<<std::endl;
 	return isLoaded;
 }
 
@@ -162,6 +284,13 @@ void SwatchMainWindow::createConnexionsMenu()
 		}
 	);
 
+	// Measure the loaded ColorSwatch with every ImageSDK (same patches geometry)
+	connect(d->mUi->action_CompareImageSDKs, &QAction::triggered, [this]()
+		{
+			compareImageSDKs();
+		}
+	);
+
 	// Save an Image
 	connect(d->mUi->action_SaveAs, &QAction::triggered, [this]()
 		{
@@ -181,6 +310,7 @@ void SwatchMainWindow::createConnexionsMenu()
 	connect(d->mUi->action_Qt, &QAction::triggered, [this]()
 		{
 			d->mImgPlg.reset( new ImagePluginQt );
+			installProgressCallback();
 			switchImageSDKandReset(d->mUi->action_Qt);
 		}
 	);
@@ -189,10 +319,46 @@ void SwatchMainWindow::createConnexionsMenu()
 	connect(d->mUi->actionOpen_ImageIO, &QAction::triggered, [this]()
 		{
 			d->mImgPlg.reset( new ImagePluginOIIO );
+			installProgressCallback();
 			switchImageSDKandReset(d->mUi->actionOpen_ImageIO);
 		}
 	);
 
+	// switch to OpenEXR SDK image plugin
+	connect(d->mUi->actionOpen_EXR, &QAction::triggered, [this]()
+		{
+			d->mImgPlg.reset( new ImagePluginOpenEXR );
+			installProgressCallback();
+			switchImageSDKandReset(d->mUi->actionOpen_EXR);
+		}
+	);
+
+#ifdef USE_LIBRAW
+	// switch to LibRaw SDK image plugin (optional build : its action is not part of the ui file)
+	QAction *actionLibRaw = d->mUi->menuImageSDK->addAction(tr("&LibRaw"));
+	actionLibRaw->setObjectName("action_LibRaw");
+	connect(actionLibRaw, &QAction::triggered, [this, actionLibRaw]()
+		{
+			d->mImgPlg.reset( new ImagePluginLibRaw );
+			installProgressCallback();
+			switchImageSDKandReset(actionLibRaw);
+		}
+	);
+#endif
+
+#ifdef USE_GRAPHICSMAGICK
+	// switch to GraphicsMagick SDK image plugin (optional build)
+	QAction *actionGraphicsMagick = d->mUi->menuImageSDK->addAction(tr("&GraphicsMagick"));
+	actionGraphicsMagick->setObjectName("action_GraphicsMagick");
+	connect(actionGraphicsMagick, &QAction::triggered, [this, actionGraphicsMagick]()
+		{
+			d->mImgPlg.reset( new ImagePluginGraphicsMagick );
+			installProgressCallback();
+			switchImageSDKandReset(actionGraphicsMagick);
+		}
+	);
+#endif
+
 }
 
 //---------------------------------------------------------------------
@@ -208,7 +374,7 @@ void SwatchMainWindow::switchImageSDKandReset(QAction* actFromMenuSDK)
 		act->objectName() == actFromMenuSDK->objectName() ? act->setChecked(true) : act->setChecked(false);
 	}
 
-	d->mUi->label->setPixmap(QPixmap());
+	showImage(QImage());
 	if(!d->mLoadedSettingsFilePath.isEmpty())
 	{
 		std::cout<<"Reload ColorWatch data structure"<<std::endl; // verbose
@@ -227,23 +393,38 @@ void SwatchMainWindow::switchImageSDKandReset(QAction* actFromMenuSDK)
 
 void SwatchMainWindow::keyPressEvent(QKeyEvent * event)
 {
+	// the progress callback processes the events while a GUI thread operation runs : only cancel it
+	// (an other operation started from here would change the plugin buffers still read by the running one)
+	if(d->mBusy)
+	{
+		if(event->key() == Qt::Key::Key_Escape)
+			d->mCancelRequested = true;
+		else
+			d->mUi->statusBar->showMessage("Busy : press Escape or Cancel to stop the current operation.");
+		event->accept();
+		return;
+	}
+
 	switch(event->key())
 	{
 	case Qt::Key::Key_Escape : this->close(); break;
 	case Qt::Key::Key_C :
 		{
-			if(d->mImgPlg->withColorSpaceHandler())
+			if(d->mLoaderThread)
+				d->mUi->statusBar->showMessage("Cannot convert ColorSpace while loading.");
+			else if(d->mImgPlg->withColorSpaceHandler())
 			{
 				static int currentClrSpID = 0;
 				QStringList clrSpaceNames;		// available OIIO ColorSpace names
 				clrSpaceNames<<"Linear"<<"sRGB"<<"GammaCorrected"<<"AdobeRGB"<<"Rec709"<<"KodakLog";
-				if( currentClrSpID >= clrSpaceNames.length())
-					currentClrSpID = 0;
-				else
-					currentClrSpID++; // increment or reinit switch ID
-				if( d->mImgPlg->toColorSpace(clrSpaceNames[currentClrSpID]) )
+				currentClrSpID = (currentClrSpID + 1) % clrSpaceNames.length(); // next one, back to Linear after the last
+				showProgress(true);
+				bool isConverted = d->mImgPlg->toColorSpace(clrSpaceNames[currentClrSpID]);
+				QImage img = isConverted ? d->mImgPlg->toQImage() : QImage();
+				showProgress(false);
+				if( isConverted )
 				{
-					d->mUi->label->setPixmap( QPixmap::fromImage( d->mImgPlg->toQImage().scaled(d->mUi->label->size(),Qt::KeepAspectRatio) ) ); // display again as QImage
+					showImage( img ); // display again as QImage
 					d->mUi->statusBar->showMessage(clrSpaceNames[currentClrSpID]+" ColorSpace conversion.");
 				}
 				else
@@ -268,18 +449,63 @@ void SwatchMainWindow::keyPressEvent(QKeyEvent * event)
 
 void SwatchMainWindow::resizeEvent(QResizeEvent * event)
 {
-	if(d->mUi->label->pixmap() != nullptr)
+	if(d->mUi->label->pixmap() != nullptr && !d->mDisplayImg.isNull())
+		d->mUi->label->setPixmap( QPixmap::fromImage(d->mDisplayImg.scaled(d->mUi->label->size(),Qt::KeepAspectRatio) ) );
+	QMainWindow::resizeEvent(event);
+}
+
+//---------------------------------------------------------------------
+
+void SwatchMainWindow::installProgressCallback()
+{
+	// plugin operations run either in the GUI thread (keep the GUI and the cancel button alive while they report progress)
+	// or in the ColorSwatchLoader thread (the progress bar is updated by a queued call)
+	d->mImgPlg->setProgressCallback([this](float done)
+		{
+			QMetaObject::invokeMethod(d->mProgressBar, "setValue", Qt::AutoConnection, Q_ARG(int, int(done * 100.0f)));
+			if(QThread::currentThread() == thread())
+				QApplication::processEvents();
+			return d->mCancelRequested.load();
+		}
+	);
+}
+
+void SwatchMainWindow::showProgress(bool visible)
+{
+	if(visible)
 	{
-		QImage img;
-		if(!d->mLoadedSettingsFilePath.isEmpty() && d->mColorSwatch != nullptr)
-			img =  d->mColorSwatch->getQImage();
-		else if(!d->mOpenedImgFilePath.isEmpty() && d->mImgPlg != nullptr)
-			img = d->mImgPlg->toQImage();
-
-		if(!img.isNull())
-			d->mUi->label->setPixmap( QPixmap::fromImage(img.scaled(d->mUi->label->size(),Qt::KeepAspectRatio) ) );
+		d->mCancelRequested = false;
+		d->mProgressBar->setValue(0);
 	}
-	QMainWindow::resizeEvent(event);
+	d->mBusy = visible;
+	d->mProgressBar->setVisible(visible);
+	d->mCancelButton->setVisible(visible);
+	d->mUi->menuBar->setEnabled(!visible); // no other operation can start from the menus while the events are processed
+}
+
+//---------------------------------------------------------------------
+
+void SwatchMainWindow::showImage(const QImage &img)
+{
+	d->mDisplayImg = img;
+	d->mUi->label->setPixmap( img.isNull() ? QPixmap() : QPixmap::fromImage(img.scaled(d->mUi->label->size(),Qt::KeepAspectRatio) ) );
+}
+
+void SwatchMainWindow::showPatches(const QVector<QRect> &patches, const QSize &imageSize)
+{
+	if(d->mDisplayImg.isNull() || imageSize.isEmpty())
+		return;
+
+	// outline the patches over the displayed image (preview or decoded image, scaled from the raw image pixel coord system)
+	QImage	img		= d->mDisplayImg.convertToFormat(QImage::Format_ARGB32);
+	qreal	scaleX	= qreal(img.width())  / imageSize.width();
+	qreal	scaleY	= qreal(img.height()) / imageSize.height();
+	QPainter painter(&img);
+	painter.setPen(QPen(Qt::red, 2));
+	for(const QRect &patch : patches)
+		painter.drawRect( QRectF(patch.x() * scaleX, patch.y() * scaleY, patch.width() * scaleX, patch.height() * scaleY) );
+	painter.end();
+	showImage(img);
 }
 
 //---------------------------------------------------------------------
@@ -338,6 +564,33 @@ void SwatchMainWindow::createGraph(
 	d->mUi->customPlot->replot(QCustomPlot::RefreshPriority::rpImmediate);
 }
 
+void SwatchMainWindow::addComparedGraph(
+	const QString &plugin,
+	GraphData2D graphR,
+	GraphData2D graphG,
+	GraphData2D graphB
+	)
+{
+	// channels colors of createGraph, one pen style per ImageSDK (in the order they finished)
+	const Qt::PenStyle	styles[]	= {Qt::SolidLine, Qt::DashLine, Qt::DotLine, Qt::DashDotLine, Qt::DashDotDotLine};
+	const QColor		colors[3]	= {Qt::red, Qt::green, Qt::blue};
+	const QString		names[3]	= {"red", "green", "blue"};
+	const GraphData2D*	graphs[3]	= {&graphR, &graphG, &graphB};
+	Qt::PenStyle		style		= styles[d->mNbComparedSDKs++ % (sizeof(styles)/sizeof(styles[0]))];
+
+	for(int c = 0; c < 3; c++)
+	{
+		QCPGraph* graph = d->mUi->customPlot->addGraph();
+		graph->setPen(QPen(QBrush(colors[c]), 1, style));
+		graph->setName(plugin + " " + names[c] + " channel");
+		graph->setData(graphs[c]->first, graphs[c]->second);
+	}
+
+	d->mUi->customPlot->rescaleAxes();
+	d->mUi->customPlot->setInteractions(QCP::iRangeDrag | QCP::iRangeZoom | QCP::iSelectPlottables);
+	d->mUi->customPlot->replot(QCustomPlot::RefreshPriority::rpImmediate);
+}
+
 //---------------------------------------------------------------------
 
 /*
@@ -2,10 +2,13 @@
 
 #include <QMainWindow>
 #include <QPair>
+#include <QRect>
+#include <QSize>
 #include <QVector>
 
 class ImagePlugin;
 class QAction;
+class QImage;
 
 class SwatchMainWindow : public QMainWindow
 {
@@ -28,14 +31,25 @@ public:
 
 protected:
 	void	createConnexionsMenu	();
-	bool	loadColorWatchSettings	(QString iniFile);
+	bool	loadColorWatchSettings	(QString iniFile);	///< start loading in a ColorSwatchLoader thread (return false if one is already running)
+	void	colorWatchSettingsLoaded(bool isLoaded, const QString &error);
+	bool	compareImageSDKs		();					///< measure the loaded ColorSwatch with every ImageSDK in a ColorSwatchComparison thread
+	void	imageSDKsCompared		(bool isCompared, const QString &error);
 	bool	openImage				(QString);
 	void	switchImageSDKandReset	(QAction* actFromMenuSDK);
+	void	showImage				(const QImage &img); ///< display img scaled to the label (kept for the resize events)
+	void	installProgressCallback	();					///< report the image plugin progress in the status bar (cancel button)
+	void	showProgress			(bool visible);
+	void	showPatches				(const QVector<QRect> &patches, const QSize &imageSize); ///< outline the patches over the displayed image
 	void	createGraph				(GraphData2D graphRef, 
 									 GraphData2D graphR,
 									 GraphData2D graphG,
 									 GraphData2D graphB,
 									 GraphData2D graphA );
+	void	addComparedGraph		(const QString &plugin,	///< add the channels graphs of one compared ImageSDK (one pen style per ImageSDK)
+									 GraphData2D graphR,
+									 GraphData2D graphG,
+									 GraphData2D graphB );
 
 private:
     class Private;